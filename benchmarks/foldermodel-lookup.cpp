@@ -0,0 +1,143 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+// Cost of finding the items of changed, removed and thumbnailed files in a
+// large folder, with the hash indexes of FolderModel and with the linear
+// scans they replaced.
+//
+// usage: foldermodel-lookup-benchmark [number of files]
+
+#include <libfm/fm.h>
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QVector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libfmqt.h"
+#include "foldermodel.h"
+#include "foldermodelitem.h"
+
+using namespace Fm;
+
+// gives access to the lookups and lets the files be inserted without a folder
+class BenchmarkModel: public FolderModel {
+public:
+  using FolderModel::insertFiles;
+  using FolderModel::insertQueuedFiles;
+  using FolderModel::findItemByName;
+  using FolderModel::findItemByFileInfo;
+};
+
+// the lookup FolderModel did before the indexes, a walk over the rows
+static FolderModelItem* linearFindByName(const QVector<FolderModelItem*>& items, const char* name, int* row) {
+  for(int i = 0; i < items.size(); ++i) {
+    if(strcmp(fm_file_info_get_name(items[i]->info), name) == 0) {
+      *row = i;
+      return items[i];
+    }
+  }
+  return NULL;
+}
+
+static FolderModelItem* linearFindByFileInfo(const QVector<FolderModelItem*>& items, FmFileInfo* info, int* row) {
+  for(int i = 0; i < items.size(); ++i) {
+    if(items[i]->info == info) {
+      *row = i;
+      return items[i];
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  if(qgetenv("QT_QPA_PLATFORM").isEmpty())
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+  LibFmQt libFmQt;
+  int fileCount = argc > 1 ? atoi(argv[1]) : 200000;
+  if(fileCount <= 0)
+    return 1;
+
+  // a synthetic folder, the files do not exist
+  QElapsedTimer timer;
+  timer.start();
+  FmPath* dir = fm_path_new_for_str("/tmp/foldermodel-benchmark");
+  FmFileInfoList* files = fm_file_info_list_new();
+  QVector<FmFileInfo*> infos;
+  infos.reserve(fileCount);
+  for(int i = 0; i < fileCount; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "file%07d.jpg", i);
+    FmPath* path = fm_path_new_child(dir, name);
+    FmFileInfo* info = fm_file_info_new();
+    fm_file_info_set_path(info, path);
+    fm_file_info_set_disp_name(info, name);
+    fm_path_unref(path);
+    fm_file_info_list_push_tail_noref(files, info);
+    infos.append(info);
+  }
+  printf("created %d file infos in %lld ms\n", fileCount, timer.elapsed());
+
+  BenchmarkModel model;
+  model.setInsertionTimeSlice(1000000);
+  timer.restart();
+  model.insertFiles(files);
+  while(model.hasQueuedFiles())
+    model.insertQueuedFiles();
+  printf("inserted them into the model in %lld ms\n", timer.elapsed());
+
+  QVector<FolderModelItem*> items;
+  items.reserve(fileCount);
+  for(int row = 0; row < model.rowCount(); ++row)
+    items.append(model.itemFromIndex(model.index(row, 0)));
+
+  // every file changed once, like a bulk touch of the folder
+  int row = 0;
+  long found = 0;
+  timer.restart();
+  for(int i = 0; i < fileCount; ++i)
+    found += model.findItemByFileInfo(infos[i], &row) != NULL;
+  qint64 hashInfoNs = timer.nsecsElapsed();
+  timer.restart();
+  for(int i = 0; i < fileCount; ++i)
+    found += model.findItemByName(fm_file_info_get_name(infos[i]), &row) != NULL;
+  qint64 hashNameNs = timer.nsecsElapsed();
+
+  // the scans are quadratic, time a sample spread over the folder and extrapolate
+  int sampleCount = qMin(fileCount, 2000);
+  int step = fileCount / sampleCount;
+  timer.restart();
+  for(int i = 0; i < sampleCount; ++i)
+    found += linearFindByFileInfo(items, infos[i * step], &row) != NULL;
+  qint64 linearInfoNs = timer.nsecsElapsed() * fileCount / sampleCount;
+  timer.restart();
+  for(int i = 0; i < sampleCount; ++i)
+    found += linearFindByName(items, fm_file_info_get_name(infos[i * step]), &row) != NULL;
+  qint64 linearNameNs = timer.nsecsElapsed() * fileCount / sampleCount;
+
+  printf("looking up all %d files (%ld found):\n", fileCount, found);
+  printf("  by FmFileInfo: %10.2f ms indexed, %10.2f ms scanning (extrapolated), %.0fx\n",
+         hashInfoNs / 1e6, linearInfoNs / 1e6, double(linearInfoNs) / qMax(hashInfoNs, qint64(1)));
+  printf("  by name:       %10.2f ms indexed, %10.2f ms scanning (extrapolated), %.0fx\n",
+         hashNameNs / 1e6, linearNameNs / 1e6, double(linearNameNs) / qMax(hashNameNs, qint64(1)));
+
+  fm_file_info_list_unref(files);
+  fm_path_unref(dir);
+  return 0;
+}
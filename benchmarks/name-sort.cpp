@@ -0,0 +1,161 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+// Cost of sorting a large folder by name, with the QCollator sort keys cached
+// in FolderModelItem (natural order) and with the glib collate keys of libfm
+// which ProxyFolderModel compared before.
+//
+// usage: name-sort-benchmark [number of files]
+
+#include <libfm/fm.h>
+#include <QApplication>
+#include <QCollator>
+#include <QElapsedTimer>
+#include <QVector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libfmqt.h"
+#include "foldermodelitem.h"
+
+using namespace Fm;
+
+// Synthetic file names, numbered the way real folders are (photos, scans,
+// episodes) plus some plain words, in mixed case. A fixed seed keeps runs
+// comparable.
+static QVector<QByteArray> makeNames(int count) {
+  static const char* const patterns[] = {
+    "IMG_%d.jpg", "Scan %d.pdf", "track%d.ogg", "Report-%d-final.odt", "notes %d.txt", "DSC%05d.NEF"
+  };
+  static const char* const words[] = {
+    "alpha", "Beta", "gamma", "Delta", "epsilon", "Zeta", "eta", "Theta"
+  };
+  QVector<QByteArray> names;
+  names.reserve(count);
+  unsigned int seed = 12345;
+  for(int i = 0; i < count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    unsigned int r = seed >> 8;
+    char name[64];
+    if(r % 4 == 0)
+      snprintf(name, sizeof(name), "%s %s %d", words[r % 8], words[(r >> 3) % 8], i);
+    else
+      snprintf(name, sizeof(name), patterns[r % 6], i);
+    names.append(name);
+  }
+  return names;
+}
+
+// a new set of file infos, so neither kind of key is cached in them yet
+static QVector<FolderModelItem*> makeItems(FmPath* dir, const QVector<QByteArray>& names) {
+  QVector<FolderModelItem*> items;
+  items.reserve(names.size());
+  Q_FOREACH(const QByteArray& name, names) {
+    FmPath* path = fm_path_new_child(dir, name.constData());
+    FmFileInfo* info = fm_file_info_new();
+    fm_file_info_set_path(info, path);
+    fm_file_info_set_disp_name(info, name.constData());
+    fm_path_unref(path);
+    items.append(new FolderModelItem(info));
+    fm_file_info_unref(info); // the item holds its own reference
+  }
+  return items;
+}
+
+struct CollatorLessThan {
+  CollatorLessThan(const QCollator& collator): collator_(collator) {
+  }
+  bool operator()(FolderModelItem* left, FolderModelItem* right) const {
+    return left->nameSortKey(collator_).compare(right->nameSortKey(collator_)) < 0;
+  }
+  const QCollator& collator_;
+};
+
+struct CollateKeyLessThan {
+  bool operator()(FolderModelItem* left, FolderModelItem* right) const {
+    return strcmp(fm_file_info_get_collate_key(left->info), fm_file_info_get_collate_key(right->info)) < 0;
+  }
+};
+
+int main(int argc, char** argv) {
+  if(qgetenv("QT_QPA_PLATFORM").isEmpty())
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+  LibFmQt libFmQt;
+  int fileCount = argc > 1 ? atoi(argv[1]) : 200000;
+  if(fileCount <= 0)
+    return 1;
+
+  QVector<QByteArray> names = makeNames(fileCount);
+  FmPath* dir = fm_path_new_for_str("/tmp/name-sort-benchmark");
+
+  // the collator ProxyFolderModel uses by default
+  QCollator collator;
+  collator.setNumericMode(true);
+  collator.setCaseSensitivity(Qt::CaseInsensitive);
+  QVector<FolderModelItem*> collatorItems = makeItems(dir, names);
+  QElapsedTimer timer;
+  timer.start();
+  Q_FOREACH(FolderModelItem* item, collatorItems)
+    item->nameSortKey(collator);
+  qint64 collatorKeysNs = timer.nsecsElapsed();
+  timer.restart();
+  std::stable_sort(collatorItems.begin(), collatorItems.end(), CollatorLessThan(collator));
+  qint64 collatorSortNs = timer.nsecsElapsed();
+  // sorting again, like after switching the order back and forth
+  std::reverse(collatorItems.begin(), collatorItems.end());
+  timer.restart();
+  std::stable_sort(collatorItems.begin(), collatorItems.end(), CollatorLessThan(collator));
+  qint64 collatorResortNs = timer.nsecsElapsed();
+
+  QVector<FolderModelItem*> collateKeyItems = makeItems(dir, names);
+  timer.restart();
+  Q_FOREACH(FolderModelItem* item, collateKeyItems)
+    fm_file_info_get_collate_key(item->info); // libfm caches it in the file info
+  qint64 collateKeysNs = timer.nsecsElapsed();
+  timer.restart();
+  std::stable_sort(collateKeyItems.begin(), collateKeyItems.end(), CollateKeyLessThan());
+  qint64 collateSortNs = timer.nsecsElapsed();
+  std::reverse(collateKeyItems.begin(), collateKeyItems.end());
+  timer.restart();
+  std::stable_sort(collateKeyItems.begin(), collateKeyItems.end(), CollateKeyLessThan());
+  qint64 collateResortNs = timer.nsecsElapsed();
+
+  printf("sorting %d files by name:\n", fileCount);
+  printf("                    %14s %14s\n", "QCollator", "collate key");
+  printf("  making the keys:  %11.2f ms %11.2f ms\n", collatorKeysNs / 1e6, collateKeysNs / 1e6);
+  printf("  first sort:       %11.2f ms %11.2f ms\n", collatorSortNs / 1e6, collateSortNs / 1e6);
+  printf("  sorting again:    %11.2f ms %11.2f ms\n", collatorResortNs / 1e6, collateResortNs / 1e6);
+  qint64 collatorTotalNs = collatorKeysNs + collatorSortNs;
+  qint64 collateTotalNs = collateKeysNs + collateSortNs;
+  printf("  keys + first sort: %10.2f ms %11.2f ms, %.2fx\n",
+         collatorTotalNs / 1e6, collateTotalNs / 1e6, double(collateTotalNs) / qMax(collatorTotalNs, qint64(1)));
+
+  // the order is what the sort keys are for, show where the two differ
+  printf("first names in natural order / collate key order:\n");
+  for(int i = 0; i < qMin(fileCount, 8); ++i)
+    printf("  %-28s %s\n", fm_file_info_get_disp_name(collatorItems[i]->info),
+           fm_file_info_get_disp_name(collateKeyItems[i]->info));
+
+  qDeleteAll(collatorItems);
+  qDeleteAll(collateKeyItems);
+  fm_path_unref(dir);
+  return 0;
+}
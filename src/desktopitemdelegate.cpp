@@ -20,6 +20,7 @@
 
 #include "desktopitemdelegate.h"
 #include "foldermodel.h"
+#include "folderitemdelegate.h"
 #include <QApplication>
 #include <QListView>
 #include <QPainter>
@@ -117,8 +118,10 @@ void DesktopItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& o
           }
         } else {
           // Draw the icon for everything else but mountpoints
-          QPixmap pixmap = opt.icon.pixmap(opt.decorationSize, iconMode);
-          painter->drawPixmap(iconPos, pixmap);
+          QPixmap pixmap = Fm::FolderItemDelegate::thumbnail(index);
+          if(pixmap.isNull())
+            pixmap = opt.icon.pixmap(opt.decorationSize, iconMode);
+          Fm::FolderItemDelegate::drawDecoration(painter, iconPos, opt.decorationSize, pixmap);
         }
   }
 
@@ -236,6 +239,14 @@ QSize DesktopItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QM
   return QSize(gridSize.width() -2, gridSize.height() - 2);
 }
 
+void DesktopItemDelegate::initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const {
+  QSize iconSize = option->decorationSize;
+  QStyledItemDelegate::initStyleOption(option, index);
+  // thumbnails are centred in the full icon size, see Fm::FolderItemDelegate
+  if((option->features & QStyleOptionViewItem::HasDecoration) && !Fm::FolderItemDelegate::thumbnail(index).isNull())
+    option->decorationSize = iconSize;
+}
+
 DesktopItemDelegate::~DesktopItemDelegate() {
 
 }
@@ -57,6 +57,9 @@ public:
     font_ = font;
   }
 
+protected:
+  virtual void initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const;
+
 private:
   QListView* view_;
   QIcon symlinkIcon_;
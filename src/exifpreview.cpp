@@ -0,0 +1,254 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "exifpreview.h"
+#include <QVector>
+#include <string.h>
+
+namespace Fm {
+
+enum {
+  TagCompression = 0x0103,
+  TagStripOffsets = 0x0111,
+  TagOrientation = 0x0112,
+  TagStripByteCounts = 0x0117,
+  TagSubIFDs = 0x014a,
+  TagJpegOffset = 0x0201, // JPEGInterchangeFormat
+  TagJpegLength = 0x0202, // JPEGInterchangeFormatLength
+  MaxIFDs = 32 // guards against IFDs linked in a loop
+};
+
+// reads the byte order dependent integers of a TIFF structure, bounds checked
+class TiffReader {
+public:
+  TiffReader(const char* data, int size):
+    data_(reinterpret_cast<const uchar*>(data)),
+    size_(size),
+    bigEndian_(false) {
+  }
+
+  // checks the TIFF header and returns the offset of the first IFD, 0 if invalid
+  quint32 readHeader() {
+    if(size_ < 8)
+      return 0;
+    if(data_[0] == 'M' && data_[1] == 'M')
+      bigEndian_ = true;
+    else if(data_[0] != 'I' || data_[1] != 'I')
+      return 0;
+    if(uint16(2) != 42)
+      return 0;
+    return uint32(4);
+  }
+
+  quint16 uint16(quint32 offset) const {
+    if(offset > quint32(size_) || size_ - offset < 2)
+      return 0;
+    const uchar* p = data_ + offset;
+    return bigEndian_ ? quint16((p[0] << 8) | p[1]) : quint16((p[1] << 8) | p[0]);
+  }
+
+  quint32 uint32(quint32 offset) const {
+    if(offset > quint32(size_) || size_ - offset < 4)
+      return 0;
+    const uchar* p = data_ + offset;
+    if(bigEndian_)
+      return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3];
+    return (quint32(p[3]) << 24) | (quint32(p[2]) << 16) | (quint32(p[1]) << 8) | p[0];
+  }
+
+  // the first value of an IFD entry, which is a SHORT or a LONG
+  quint32 value(quint32 entry) const {
+    return uint16(entry + 2) == 3 ? uint16(entry + 8) : uint32(entry + 8);
+  }
+
+private:
+  const uchar* data_;
+  int size_;
+  bool bigEndian_;
+};
+
+// the size of a baseline or progressive JPEG from its SOF marker.
+// Lossless JPEG, used for the raw data of some RAW files, is not accepted.
+static bool readJpegSize(const char* data, int size, int* width, int* height) {
+  const uchar* p = reinterpret_cast<const uchar*>(data);
+  if(size < 4 || p[0] != 0xff || p[1] != 0xd8)
+    return false;
+  int pos = 2;
+  while(pos + 4 <= size) {
+    if(p[pos] != 0xff)
+      return false;
+    uchar marker = p[pos + 1];
+    if(marker == 0xff) { // fill byte
+      ++pos;
+      continue;
+    }
+    int length = (p[pos + 2] << 8) | p[pos + 3];
+    if(marker == 0xc0 || marker == 0xc1 || marker == 0xc2) {
+      if(length < 7 || pos + 9 > size)
+        return false;
+      *height = (p[pos + 5] << 8) | p[pos + 6];
+      *width = (p[pos + 7] << 8) | p[pos + 8];
+      return *width > 0 && *height > 0;
+    }
+    // other frame types, or the image data without a supported frame before it
+    if((marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) || marker == 0xda)
+      return false;
+    pos += 2 + length;
+  }
+  return false;
+}
+
+// Collect the JPEG images of the IFD chain starting at ifd and of its
+// sub-IFDs. The orientation is taken from the first IFD.
+static void collectPreviews(const TiffReader& tiff, const char* base, int size, quint32 ifd,
+                            QVector<EmbeddedPreview>& previews, int* orientation, int* visited) {
+  while(ifd != 0 && *visited < MaxIFDs) {
+    // counted before the sub-IFDs, which may link back to this one
+    bool first = (*visited)++ == 0;
+    int count = tiff.uint16(ifd);
+    if(count == 0)
+      return;
+    quint32 jpegOffset = 0, jpegLength = 0, stripOffset = 0, stripLength = 0;
+    int compression = 0;
+    for(int i = 0; i < count; ++i) {
+      quint32 entry = ifd + 2 + i * 12;
+      quint16 tag = tiff.uint16(entry);
+      quint32 valueCount = tiff.uint32(entry + 4);
+      switch(tag) {
+        case TagCompression:
+          compression = tiff.value(entry);
+          break;
+        case TagOrientation:
+          if(first)
+            *orientation = tiff.value(entry);
+          break;
+        case TagJpegOffset:
+          jpegOffset = tiff.value(entry);
+          break;
+        case TagJpegLength:
+          jpegLength = tiff.value(entry);
+          break;
+        // a JPEG stored as the image of the IFD is only usable in one piece
+        case TagStripOffsets:
+          if(valueCount == 1)
+            stripOffset = tiff.value(entry);
+          break;
+        case TagStripByteCounts:
+          if(valueCount == 1)
+            stripLength = tiff.value(entry);
+          break;
+        case TagSubIFDs: {
+          // more than one offset does not fit into the entry, it points to them instead
+          quint32 offsets = valueCount == 1 ? entry + 8 : tiff.uint32(entry + 8);
+          for(quint32 n = 0; n < valueCount && n < MaxIFDs; ++n)
+            collectPreviews(tiff, base, size, tiff.uint32(offsets + n * 4), previews, orientation, visited);
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    // old and new style JPEG compression
+    if(compression != 6 && compression != 7)
+      stripOffset = stripLength = 0;
+    quint32 offsets[2] = {jpegOffset, stripOffset};
+    quint32 lengths[2] = {jpegLength, stripLength};
+    for(int i = 0; i < 2; ++i) {
+      if(offsets[i] == 0 || lengths[i] == 0 || offsets[i] > quint32(size) || lengths[i] > size - offsets[i])
+        continue;
+      EmbeddedPreview preview;
+      preview.offset = int(offsets[i]);
+      preview.length = int(lengths[i]);
+      preview.orientation = 1;
+      if(readJpegSize(base + preview.offset, preview.length, &preview.width, &preview.height))
+        previews.append(preview);
+    }
+    ifd = tiff.uint32(ifd + 2 + count * 12);
+  }
+}
+
+bool findEmbeddedPreview(const char* data, int size, int minSize, EmbeddedPreview* preview) {
+  const uchar* p = reinterpret_cast<const uchar*>(data);
+  const char* tiffData = NULL;
+  int tiffSize = 0;
+  int photoWidth = 0, photoHeight = 0;
+
+  if(size >= 4 && p[0] == 0xff && p[1] == 0xd8) {
+    // the EXIF data is in an APP1 segment in front of the image
+    int pos = 2;
+    while(pos + 4 <= size && p[pos] == 0xff && p[pos + 1] != 0xda) {
+      int length = (p[pos + 2] << 8) | p[pos + 3];
+      if(p[pos + 1] == 0xe1 && length >= 16 && pos + 2 + length <= size && memcmp(data + pos + 4, "Exif\0\0", 6) == 0) {
+        tiffData = data + pos + 10;
+        tiffSize = length - 8;
+        break;
+      }
+      pos += 2 + length;
+    }
+    if(!tiffData || !readJpegSize(data, size, &photoWidth, &photoHeight))
+      return false;
+  }
+  else {
+    tiffData = data;
+    tiffSize = size;
+  }
+
+  // offsets in the EXIF data are relative to the TIFF header
+  TiffReader tiff(tiffData, tiffSize);
+  quint32 ifd = tiff.readHeader();
+  if(ifd == 0)
+    return false;
+  QVector<EmbeddedPreview> previews;
+  int orientation = 1;
+  int visited = 0;
+  collectPreviews(tiff, tiffData, tiffSize, ifd, previews, &orientation, &visited);
+  if(orientation < 1 || orientation > 8)
+    orientation = 1;
+
+  // RAW files do not tell the size of the developed photo, go by the largest preview
+  if(photoWidth == 0) {
+    Q_FOREACH(const EmbeddedPreview& candidate, previews) {
+      if(qint64(candidate.width) * candidate.height > qint64(photoWidth) * photoHeight) {
+        photoWidth = candidate.width;
+        photoHeight = candidate.height;
+      }
+    }
+  }
+
+  const EmbeddedPreview* best = NULL;
+  for(int i = 0; i < previews.size(); ++i) {
+    const EmbeddedPreview& candidate = previews[i];
+    if(qMax(candidate.width, candidate.height) < minSize)
+      continue;
+    // the aspect ratios may differ by 2%
+    qint64 a = qint64(candidate.width) * photoHeight;
+    qint64 b = qint64(candidate.height) * photoWidth;
+    if(qAbs(a - b) * 50 > qMax(a, b))
+      continue;
+    if(!best || qint64(candidate.width) * candidate.height < qint64(best->width) * best->height)
+      best = &candidate;
+  }
+  if(!best)
+    return false;
+  *preview = *best;
+  preview->offset += int(tiffData - data);
+  preview->orientation = orientation;
+  return true;
+}
+
+}
@@ -0,0 +1,45 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_EXIFPREVIEW_H
+#define FM_EXIFPREVIEW_H
+
+#include "libfmqtglobals.h"
+
+namespace Fm {
+
+// A JPEG image embedded in a photo, found by findEmbeddedPreview().
+struct LIBFM_QT_API EmbeddedPreview {
+  int offset; // of the JPEG data in the file
+  int length;
+  int width;
+  int height;
+  int orientation; // EXIF orientation (1-8) of the photo, the preview is stored the same way
+};
+
+// Find the smallest JPEG preview embedded in a photo which is at least
+// minSize pixels on its longer side. JPEG files are searched for the EXIF
+// thumbnail, and TIFF based camera RAW files (CR2, NEF, ARW, DNG and the
+// like) for the previews in their IFDs. Only the headers are read, and
+// previews which do not have the aspect ratio of the photo, like letterboxed
+// EXIF thumbnails, are skipped. Returns false if there is no such preview.
+LIBFM_QT_API bool findEmbeddedPreview(const char* data, int size, int minSize, EmbeddedPreview* preview);
+
+}
+
+#endif // FM_EXIFPREVIEW_H
@@ -0,0 +1,90 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "filebuffer.h"
+#include <QList>
+#include <QMutex>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+static QMutex bufferPoolLock;
+static QList<QByteArray> bufferPool;
+static const int maxPooledBuffers = 4;
+static const int maxPooledBufferSize = 16 * 1024 * 1024;
+
+QByteArray takeFileBuffer(int size) {
+  QByteArray buffer;
+  bufferPoolLock.lock();
+  if(!bufferPool.isEmpty())
+    buffer = bufferPool.takeLast();
+  bufferPoolLock.unlock();
+  buffer.reserve(size); // also keeps resize() from shrinking the allocation
+  buffer.resize(size);
+  return buffer;
+}
+
+void returnFileBuffer(QByteArray& buffer) {
+  if(buffer.capacity() <= maxPooledBufferSize) {
+    bufferPoolLock.lock();
+    if(bufferPool.size() < maxPooledBuffers)
+      bufferPool.append(buffer);
+    bufferPoolLock.unlock();
+  }
+  // the pool's copy must be the only one, or reusing it would detach
+  buffer = QByteArray();
+}
+
+bool readWholeFile(const char* path, QByteArray* buffer) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd == -1)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) {
+    close(fd);
+    return false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  QByteArray data = takeFileBuffer(int(st.st_size));
+  // usually done in one call, unless the file shrinks meanwhile
+  int total = 0;
+  while(total < data.size()) {
+    ssize_t n = read(fd, data.data() + total, data.size() - total);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      break;
+    total += int(n);
+  }
+  close(fd);
+  if(total == 0) {
+    returnFileBuffer(data);
+    return false;
+  }
+  data.resize(total);
+  *buffer = data;
+  return true;
+}
+
+}
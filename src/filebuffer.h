@@ -0,0 +1,41 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_FILEBUFFER_H
+#define FM_FILEBUFFER_H
+
+#include "libfmqtglobals.h"
+#include <QByteArray>
+
+namespace Fm {
+
+// Buffers for reading whole image files, kept for the next file instead of
+// allocating one per image. takeFileBuffer() returns one resized to size.
+// returnFileBuffer() takes it back and leaves buffer null. Large buffers
+// are freed instead, to bound the memory held.
+LIBFM_QT_API QByteArray takeFileBuffer(int size);
+LIBFM_QT_API void returnFileBuffer(QByteArray& buffer);
+
+// Read a whole local regular file into a buffer from the pool. The files are
+// copied rather than mapped: a mapped file truncated by another program while
+// it is decoded, e.g. by cp or a shell redirect, would crash us with SIGBUS.
+LIBFM_QT_API bool readWholeFile(const char* path, QByteArray* buffer);
+
+}
+
+#endif // FM_FILEBUFFER_H
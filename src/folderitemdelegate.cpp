@@ -66,6 +66,29 @@ QSize FolderItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QMo
   return QStyledItemDelegate::sizeHint(option, index);
 }
 
+//static
+QPixmap FolderItemDelegate::thumbnail(const QModelIndex& index) {
+  QVariant decoration = index.data(Qt::DecorationRole);
+  return decoration.type() == QVariant::Pixmap ? qvariant_cast<QPixmap>(decoration) : QPixmap();
+}
+
+//static
+void FolderItemDelegate::drawDecoration(QPainter* painter, const QPoint& pos, const QSize& size, const QPixmap& pixmap) {
+  QSize pixmapSize = pixmap.size() / pixmap.devicePixelRatio();
+  painter->drawPixmap(pos.x() + (size.width() - pixmapSize.width()) / 2,
+                      pos.y() + (size.height() - pixmapSize.height()) / 2, pixmap);
+}
+
+void FolderItemDelegate::initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const {
+  QSize iconSize = option->decorationSize;
+  QStyledItemDelegate::initStyleOption(option, index);
+  // QStyledItemDelegate takes the size of the thumbnail as the decoration size.
+  // Thumbnails keep their aspect ratio, so lay the item out with the full icon
+  // size instead and let the thumbnail be centred in it.
+  if((option->features & QStyleOptionViewItem::HasDecoration) && !thumbnail(index).isNull())
+    option->decorationSize = iconSize;
+}
+
 QIcon::Mode FolderItemDelegate::iconModeFromState(QStyle::State state) {
   QIcon::Mode iconMode;
   if(state & QStyle::State_Enabled) {
@@ -113,8 +136,11 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
       painter->fillPath(path, QColor(196, 196, 196)); // Light gray
     }
 
-    QPixmap pixmap = opt.icon.pixmap(opt.decorationSize, iconMode);
-    painter->drawPixmap(iconPos, pixmap);
+    // draw thumbnails as they are instead of going through QIcon
+    QPixmap pixmap = thumbnail(index);
+    if(pixmap.isNull())
+      pixmap = opt.icon.pixmap(opt.decorationSize, iconMode);
+    drawDecoration(painter, iconPos, opt.decorationSize, pixmap);
 
     // draw some emblems for the item if needed
     // we only support symlink emblem at the moment
@@ -44,6 +44,14 @@ public:
   virtual QSize sizeHint(const QStyleOptionViewItem & option, const QModelIndex & index) const;
   virtual void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const;
 
+  // the thumbnail shown for index, null if the item shows an icon
+  static QPixmap thumbnail(const QModelIndex& index);
+  // draw pixmap centred in the decoration area of the given size at pos
+  static void drawDecoration(QPainter* painter, const QPoint& pos, const QSize& size, const QPixmap& pixmap);
+
+protected:
+  virtual void initStyleOption(QStyleOptionViewItem* option, const QModelIndex& index) const;
+
 private:
   void drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const;
   static QIcon::Mode iconModeFromState(QStyle::State state);
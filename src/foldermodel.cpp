@@ -21,18 +21,24 @@
 #include "foldermodel.h"
 #include "icontheme.h"
 #include <iostream>
+#include <algorithm>
 #include <QtAlgorithms>
 #include <QVector>
 #include <qmimedata.h>
 #include <QMimeData>
 #include <QByteArray>
 #include <QPixmap>
-#include <QPainter>
+#include <QGuiApplication>
 #include <QDebug>
+#include <QTimer>
+#include <QElapsedTimer>
 #include "utilities.h"
 #include "fileoperation.h"
-#include "thumbnailloader.h"
+#include "thumbnailengine.h"
+#include "thumbnailcache.h"
+#include "thumbnailscaler.h"
 #include "folderview.h"
+#include "volumelabelresolver.h"
 
 #include "fm-path.h"
 
@@ -40,7 +46,16 @@ using namespace Fm;
 
 FolderModel::FolderModel() :
   folder_(NULL),
-  computerFolder_(NULL) {
+  computerFolder_(NULL),
+  removalResetRatio_(0.25),
+  pendingPos_(0),
+  insertedCount_(0),
+  insertionTimeSlice_(8),
+  finishLoadingPending_(false),
+  hotEventRate_(50),
+  eventCount_(0),
+  hotMode_(false),
+  namesValid_(false) {
 /*
     ColumnIcon,
     ColumnName,
@@ -53,6 +68,27 @@ FolderModel::FolderModel() :
 
   // reload all icons when the icon theme is changed
   connect(IconTheme::instance(), &IconTheme::changed, this, &FolderModel::updateIcons);
+
+  // show volume labels of mount points once they are looked up
+  connect(VolumeLabelResolver::instance(), &VolumeLabelResolver::labelResolved, this, &FolderModel::onVolumeLabelResolved);
+  connect(VolumeLabelResolver::instance(), &VolumeLabelResolver::labelsInvalidated, this, &FolderModel::onVolumeLabelsInvalidated);
+
+  // insert the remaining queued files once the event loop got a chance to run
+  insertionTimer_ = new QTimer(this);
+  insertionTimer_->setSingleShot(true);
+  insertionTimer_->setInterval(0);
+  connect(insertionTimer_, &QTimer::timeout, this, &FolderModel::insertQueuedFiles);
+
+  // report changed files at most once per frame
+  changeTimer_ = new QTimer(this);
+  changeTimer_->setSingleShot(true);
+  changeTimer_->setInterval(16);
+  connect(changeTimer_, &QTimer::timeout, this, &FolderModel::flushChangedItems);
+
+  // measure the rate of file events while there are any
+  rateTimer_ = new QTimer(this);
+  rateTimer_->setInterval(1000);
+  connect(rateTimer_, &QTimer::timeout, this, &FolderModel::measureEventRate);
 }
 
 FolderModel::~FolderModel() {
@@ -66,8 +102,8 @@ FolderModel::~FolderModel() {
 
   // if the thumbnail requests list is not empty, cancel them
   if(!thumbnailResults.empty()) {
-    Q_FOREACH(FmThumbnailLoader* res, thumbnailResults) {
-      ThumbnailLoader::cancel(res);
+    Q_FOREACH(ThumbnailRequest* request, thumbnailResults.keys()) {
+      ThumbnailEngine::instance()->cancel(request);
     }
   }
 }
@@ -100,7 +136,7 @@ void FolderModel::setFolder(FmFolder* new_folder, bool add_devices) {
     g_signal_connect(folder_, "files-removed", G_CALLBACK(onFilesRemoved), this);
     // handle the case if the folder is already loaded
     if(fm_folder_is_loaded(folder_))
-      insertFiles(0, fm_folder_get_files(folder_));
+      insertFiles(fm_folder_get_files(folder_));
   }
   else
     folder_ = NULL;
@@ -115,7 +151,7 @@ void FolderModel::setFolder(FmFolder* new_folder, bool add_devices) {
       g_signal_connect(computerFolder_, "files-removed", G_CALLBACK(onFilesRemoved), this);
       // handle the case if the folder is already loaded
       if(fm_folder_is_loaded(computerFolder_))
-        insertFiles(0, fm_folder_get_files(computerFolder_));
+        insertFiles(fm_folder_get_files(computerFolder_));
     }
   }
   else {
@@ -127,6 +163,7 @@ void FolderModel::onStartLoading(FmFolder* folder, gpointer user_data) {
   FolderModel* model = static_cast<FolderModel*>(user_data);
   // remove all items
   model->removeAll();
+  Q_EMIT model->loadingStarted();
 }
 
 void FolderModel::onFinishLoading(FmFolder* folder, gpointer user_data) {
@@ -136,11 +173,23 @@ void FolderModel::onFinishLoading(FmFolder* folder, gpointer user_data) {
 }
 
 void FolderModel::onFinishedLoading() {
+  // the files are not all in the model yet, select them after the last slice
+  if(hasQueuedFiles()) {
+    finishLoadingPending_ = true;
+    return;
+  }
+  Q_EMIT loadingFinished();
   if(filesToSelect.count() > 0)
     ((FolderView *)filesToSelectView)->selectFiles(filesToSelect, filesToSelectAdd);
   filesToSelect.clear();
 }
 
+bool FolderModel::isLoading() const {
+  return (folder_ && !fm_folder_is_loaded(folder_))
+         || (computerFolder_ && !fm_folder_is_loaded(computerFolder_))
+         || hasQueuedFiles();
+}
+
 void FolderModel::wantToSelect(QStringList files, bool add, void *view) {
   filesToSelect = files;
   filesToSelectAdd = add;
@@ -155,86 +204,274 @@ void FolderModel::onFilesAdded(FmFolder* folder, GSList* files, gpointer user_da
   // device files again when it is reconstructed
   if (model->computerFolder()
       && (folder != model->computerFolder())
-      && (model->items.count() == 0)) {
+      && (model->items.count() == 0)
+      && !model->hasQueuedFiles()) {
     FmFileInfoList* computerFiles = fm_folder_get_files(model->computerFolder());
-    int n_files = fm_file_info_list_get_length(computerFiles);
-    model->beginInsertRows(QModelIndex(), 0, n_files - 1);
-    for(GList* l = fm_file_info_list_peek_head_link(computerFiles); l; l = l->next) {
-      FolderModelItem item(FM_FILE_INFO(l->data));
-      model->items.append(item);
-    }
-    model->endInsertRows();
+    for(GList* l = fm_file_info_list_peek_head_link(computerFiles); l; l = l->next)
+      model->queueFile(FM_FILE_INFO(l->data));
   }
 
-  int n_files = g_slist_length(files);
-  model->beginInsertRows(QModelIndex(), model->items.count(), model->items.count() + n_files - 1);
-  for(GSList* l = files; l; l = l->next) {
-    FmFileInfo* info = FM_FILE_INFO(l->data);
-    FolderModelItem item(info);
-/*
-    if(fm_file_info_is_hidden(info)) {
-      model->hiddenItems.append(item);
-      continue;
-    }
-*/
-    model->items.append(item);
-  }
-  model->endInsertRows();
+  for(GSList* l = files; l; l = l->next)
+    model->queueFile(FM_FILE_INFO(l->data));
+  model->noteFolderEvents(folder, g_slist_length(files));
+  // hot folders insert new files in batches from the timer
+  if(!model->hotMode_)
+    model->insertQueuedFiles();
+  else if(!model->insertionTimer_->isActive())
+    model->insertionTimer_->start();
 }
 
 //static
 void FolderModel::onFilesChanged(FmFolder* folder, GSList* files, gpointer user_data) {
   FolderModel* model = static_cast<FolderModel*>(user_data);
+  // only remember the items here. Files being written to are reported many
+  // times a second, and flushChangedItems() handles them all in one go.
   for(GSList* l = files; l; l = l->next) {
     FmFileInfo* info = FM_FILE_INFO(l->data);
     int row;
-    QList<FolderModelItem>::iterator it = model->findItemByFileInfo(info, &row);
-    if(it != model->items.end()) {
-      FolderModelItem& item = *it;
-      // try to update the item
-      item.displayName = QString::fromUtf8(fm_file_info_get_disp_name(info));
-      item.updateIcon();
-      item.thumbnails.clear();
-      QModelIndex index = model->createIndex(row, 0, &item);
-      Q_EMIT model->dataChanged(index, index);
-    }
+    FolderModelItem* item = model->findItemByFileInfo(info, &row);
+    if(item)
+      model->changedItems_.insert(item);
   }
+  model->noteFolderEvents(folder, g_slist_length(files));
+  if(!model->changedItems_.isEmpty() && !model->changeTimer_->isActive())
+    model->changeTimer_->start();
 }
 
 //static
 void FolderModel::onFilesRemoved(FmFolder* folder, GSList* files, gpointer user_data) {
   FolderModel* model = static_cast<FolderModel*>(user_data);
+  model->noteFolderEvents(folder, g_slist_length(files));
+  if(model->hasQueuedFiles())
+    model->unqueueFiles(files);
+  // collect the rows first so they can be removed in contiguous ranges
+  QVector<int> rows;
+  rows.reserve(g_slist_length(files));
   for(GSList* l = files; l; l = l->next) {
     FmFileInfo* info = FM_FILE_INFO(l->data);
-    const char* name = fm_file_info_get_name(info);
     int row;
-    QList<FolderModelItem>::iterator it = model->findItemByName(name, &row);
-    if(it != model->items.end()) {
-      model->beginRemoveRows(QModelIndex(), row, row);
-      model->items.erase(it);
-      model->endRemoveRows();
-    }
+    // libfm passes us the same FmFileInfo objects we hold, but the desktop
+    // model merges two folders, so fall back to the name if it is not found.
+    FolderModelItem* item = model->findItemByFileInfo(info, &row);
+    if(!item)
+      item = model->findItemByName(fm_file_info_get_name(info), &row);
+    if(item)
+      rows.append(row);
   }
+  model->removeItems(rows);
 }
 
-void FolderModel::insertFiles(int row, FmFileInfoList* files) {
-  int n_files = fm_file_info_list_get_length(files);
-  beginInsertRows(QModelIndex(), row, row + n_files - 1);
-  for(GList* l = fm_file_info_list_peek_head_link(files); l; l = l->next) {
-    FolderModelItem item(FM_FILE_INFO(l->data));
-    items.append(item);
+void FolderModel::insertFiles(FmFileInfoList* files) {
+  for(GList* l = fm_file_info_list_peek_head_link(files); l; l = l->next)
+    queueFile(FM_FILE_INFO(l->data));
+  insertQueuedFiles();
+}
+
+// add a file to the queue of files waiting to be inserted into the model
+void FolderModel::queueFile(FmFileInfo* info) {
+  queuedFiles_.append(fm_file_info_ref(info));
+}
+
+// drop files which are removed from the folder before they got inserted
+void FolderModel::unqueueFiles(GSList* files) {
+  QSet<FmFileInfo*> removed;
+  for(GSList* l = files; l; l = l->next)
+    removed.insert(FM_FILE_INFO(l->data));
+  int n = pendingPos_;
+  for(int i = pendingPos_; i < queuedFiles_.size(); ++i) {
+    FmFileInfo* info = queuedFiles_[i];
+    if(removed.contains(info))
+      fm_file_info_unref(info);
+    else
+      queuedFiles_[n++] = info;
   }
+  queuedFiles_.resize(n);
+}
+
+void FolderModel::clearQueuedFiles() {
+  for(int i = pendingPos_; i < queuedFiles_.size(); ++i)
+    fm_file_info_unref(queuedFiles_[i]);
+  queuedFiles_.clear();
+  pendingPos_ = 0;
+  insertedCount_ = 0;
+  finishLoadingPending_ = false;
+  insertionTimer_->stop();
+}
+
+// Create items for the queued files and insert them into the model.
+// Building an item is not cheap (icon lookup, bundle checks), so only
+// as many items as fit in insertionTimeSlice() are built per call, and
+// the rest is left to the next iteration of the event loop so the UI
+// stays responsive while very large folders are loaded.
+void FolderModel::insertQueuedFiles() {
+  if(!hasQueuedFiles())
+    return;
+  QElapsedTimer timer;
+  timer.start();
+  QVector<FolderModelItem*> newItems;
+  newItems.reserve(qMin(queuedFiles_.size() - pendingPos_, 1024));
+  while(pendingPos_ < queuedFiles_.size()) {
+    FmFileInfo* info = queuedFiles_[pendingPos_++];
+    newItems.append(createItem(info));
+    fm_file_info_unref(info); // the item holds its own reference
+    // checking the clock is not free either, so only do it every few items
+    if((newItems.size() % 32) == 0 && timer.elapsed() >= insertionTimeSlice_)
+      break;
+  }
+
+  int first = items.size();
+  beginInsertRows(QModelIndex(), first, first + newItems.size() - 1);
+  items += newItems;
+  updateRows(first);
   endInsertRows();
+  insertedCount_ += newItems.size();
+
+  int total = insertedCount_ + queuedFiles_.size() - pendingPos_;
+  Q_EMIT insertionProgress(insertedCount_, total);
+
+  if(hasQueuedFiles()) {
+    insertionTimer_->start(); // continue after the pending events are handled
+  }
+  else {
+    // isLoading() was true between the slices if there was more than one
+    bool sliced = insertedCount_ != newItems.size();
+    queuedFiles_.clear();
+    pendingPos_ = 0;
+    insertedCount_ = 0;
+    if(finishLoadingPending_) {
+      finishLoadingPending_ = false;
+      onFinishedLoading();
+    }
+    else if(sliced && !isLoading()) {
+      // libfm does not report the end of this, e.g. when a folder which is
+      // already loaded is set. The proxy models wait for it to sort again.
+      Q_EMIT loadingFinished();
+    }
+  }
+}
+
+// remove the items at the specified rows.
+// Adjacent rows are removed with a single beginRemoveRows()/endRemoveRows() pair
+// so the proxy models and views only need to update once per range.
+void FolderModel::removeItems(QVector<int>& rows) {
+  if(rows.isEmpty())
+    return;
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+  // removing a large part of the folder, resetting the model is cheaper
+  bool reset = rows.size() > 1 && rows.size() > removalResetRatio_ * items.size();
+  if(reset)
+    beginResetModel();
+
+  // walk the ranges backwards so the rows of the remaining ranges stay valid
+  int last = rows.size() - 1;
+  while(last >= 0) {
+    int first = last;
+    while(first > 0 && rows[first - 1] == rows[first] - 1)
+      --first;
+    int firstRow = rows[first];
+    int lastRow = rows[last];
+    if(!reset)
+      beginRemoveRows(QModelIndex(), firstRow, lastRow);
+    for(int row = firstRow; row <= lastRow; ++row)
+      destroyItem(items[row]);
+    items.remove(firstRow, lastRow - firstRow + 1);
+    if(!reset)
+      endRemoveRows();
+    last = first - 1;
+  }
+  updateRows(rows.first());
+
+  if(reset) {
+    // the views reload everything anyway, no need to report the changed items
+    invalidateChangedItems();
+    // nobody holds pointers to our items during a reset, so it's
+    // a good time to give the memory of the erased items back.
+    if(store_.isFragmented()) {
+      // the pointers to the items change, give up on the deferred thumbnails
+      clearThumbnails(staleThumbnails_);
+      staleThumbnails_.clear();
+      store_.compact(items);
+      rebuildIndex();
+      // the slots changed, the names are collected again when needed
+      names_.clear();
+      namesValid_ = false;
+    }
+    endResetModel();
+  }
 }
 
 void FolderModel::removeAll() {
+  clearQueuedFiles();
+  changedItems_.clear();
+  changeTimer_->stop();
+  staleThumbnails_.clear();
+  names_.clear();
+  namesValid_ = false;
   if(items.empty())
     return;
   beginRemoveRows(QModelIndex(), 0, items.size() - 1);
   items.clear();
+  nameIndex_.clear();
+  infoIndex_.clear();
+  mountPoints_.clear();
+  store_.clear();
   endRemoveRows();
 }
 
+// create a new item in the store and add it to the lookup tables.
+// The caller needs to put the item into items and set its row.
+FolderModelItem* FolderModel::createItem(FmFileInfo* info) {
+  FolderModelItem* item = store_.create(info);
+  indexItem(item);
+  if(namesValid_)
+    names_.insert(item->slot, fm_file_info_get_name(info));
+  return item;
+}
+
+// remove the item from the lookup tables and destroy it.
+// The caller needs to remove it from items.
+void FolderModel::destroyItem(FolderModelItem* item) {
+  FmFileInfo* info = item->info;
+  const char* name = fm_file_info_get_name(info);
+  // only this item's entry, another item may have the same name
+  nameIndex_.remove(QByteArray::fromRawData(name, strlen(name)), item);
+  infoIndex_.remove(info);
+  mountPoints_.remove(item);
+  changedItems_.remove(item);
+  staleThumbnails_.remove(item);
+  if(namesValid_)
+    names_.remove(item->slot);
+  store_.destroy(item);
+}
+
+void FolderModel::indexItem(FolderModelItem* item) {
+  FmFileInfo* info = item->info;
+  nameIndex_.insert(QByteArray(fm_file_info_get_name(info)), item);
+  infoIndex_.insert(info, item);
+  if(item->isMountPoint())
+    mountPoints_.insert(item);
+}
+
+// rebuild the lookup tables after the items are moved in memory
+void FolderModel::rebuildIndex() {
+  nameIndex_.clear();
+  infoIndex_.clear();
+  mountPoints_.clear();
+  nameIndex_.reserve(items.size());
+  infoIndex_.reserve(items.size());
+  Q_FOREACH(FolderModelItem* item, items) {
+    indexItem(item);
+  }
+}
+
+// rows at and after row have been shifted, update the row numbers stored in the items
+void FolderModel::updateRows(int row) {
+  for(int i = row; i < items.size(); ++i)
+    items[i]->row = i;
+}
+
 int FolderModel::rowCount(const QModelIndex & parent) const {
   if(parent.isValid())
     return 0;
@@ -257,7 +494,7 @@ FmFileInfo* FolderModel::fileInfoFromIndex(const QModelIndex& index) const {
 }
 
 QVariant FolderModel::data(const QModelIndex & index, int role = Qt::DisplayRole) const {
-  if(!index.isValid() || index.row() > items.size() || index.column() >= NumOfColumns) {
+  if(!index.isValid() || index.row() >= items.size() || index.column() >= NumOfColumns) {
     return QVariant();
   }
   FolderModelItem* item = itemFromIndex(index);
@@ -265,35 +502,25 @@ QVariant FolderModel::data(const QModelIndex & index, int role = Qt::DisplayRole
 
   switch(role) {
     case Qt::ToolTipRole:
-      return QVariant(item->displayName);
+      return QVariant(item->displayName());
     case Qt::DisplayRole:  {
       switch(index.column()) {
-        case ColumnFileName: {
-          return QVariant(item->displayName);
-        }
-        case ColumnFileType: {
-          FmMimeType* mime = fm_file_info_get_mime_type(info);
-          const char* desc = fm_mime_type_get_desc(mime);
-          return QString::fromUtf8(desc);
-        }
-        case ColumnFileMTime: {
-          const char* name = fm_file_info_get_disp_mtime(info);
-          return QString::fromUtf8(name);
-        }
-        case ColumnFileSize: {
-          const char* name = fm_file_info_get_disp_size(info);
-          return QString::fromUtf8(name);
-        }
-        case ColumnFileOwner: {
-          const char* name = fm_file_info_get_disp_owner(info);
-          return QString::fromUtf8(name);
-        }
+        case ColumnFileName:
+          return QVariant(item->displayName());
+        case ColumnFileType:
+          return QVariant(item->mimeDescription());
+        case ColumnFileMTime:
+          return QVariant(item->dispMTime());
+        case ColumnFileSize:
+          return QVariant(item->dispSize());
+        case ColumnFileOwner:
+          return QVariant(item->dispOwner());
       }
     }
     case Qt::DecorationRole: {
       if(index.column() == 0) {
         // QPixmap pix = IconTheme::loadIcon(fm_file_info_get_icon(info), iconSize_);
-        return QVariant(item->icon);
+        return QVariant(item->icon());
         // return QVariant(pix);
       }
       break;
@@ -334,8 +561,7 @@ QVariant FolderModel::headerData(int section, Qt::Orientation orientation, int r
 QModelIndex FolderModel::index(int row, int column, const QModelIndex & parent) const {
   if(row <0 || row >= items.size() || column < 0 || column >= NumOfColumns)
     return QModelIndex();
-  const FolderModelItem& item = items.at(row);
-  return createIndex(row, column, (void*)&item);
+  return createIndex(row, column, items.at(row));
 }
 
 QModelIndex FolderModel::parent(const QModelIndex & index) const {
@@ -356,55 +582,33 @@ Qt::ItemFlags FolderModel::flags(const QModelIndex& index) const {
   return flags;
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
-QList<FolderModelItem>::iterator FolderModel::findItemByPath(FmPath* path, int* row) {
-  QList<FolderModelItem>::iterator it = items.begin();
-  int i = 0;
-  while(it != items.end()) {
-    FolderModelItem& item = *it;
-    FmPath* item_path = fm_file_info_get_path(item.info);
-    if(fm_path_equal(item_path, path)) {
-      *row = i;
-      return it;
+FolderModelItem* FolderModel::findItemByPath(FmPath* path, int* row) {
+  const char* name = fm_path_get_basename(path);
+  // items of the computer folder may share a name with a file in the folder
+  QMultiHash<QByteArray, FolderModelItem*>::const_iterator it = nameIndex_.constFind(QByteArray::fromRawData(name, strlen(name)));
+  for(; it != nameIndex_.constEnd() && it.key() == name; ++it) {
+    FolderModelItem* item = it.value();
+    if(fm_path_equal(fm_file_info_get_path(item->info), path)) {
+      *row = item->row;
+      return item;
     }
-    ++it;
-    ++i;
-  }
-  return items.end();
-}
-
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
-QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
-  QList<FolderModelItem>::iterator it = items.begin();
-  int i = 0;
-  while(it != items.end()) {
-    FolderModelItem& item = *it;
-    const char* item_name = fm_file_info_get_name(item.info);
-    if(strcmp(name, item_name) == 0) {
-      *row = i;
-      return it;
-    }
-    ++it;
-    ++i;
   }
-  return items.end();
+  return NULL;
 }
 
-QList< FolderModelItem >::iterator FolderModel::findItemByFileInfo(FmFileInfo* info, int* row) {
-  QList<FolderModelItem>::iterator it = items.begin();
-  int i = 0;
-  while(it != items.end()) {
-    FolderModelItem& item = *it;
-    if(item.info == info) {
-      *row = i;
-      return it;
-    }
-    ++it;
-    ++i;
-  }
-  return items.end();
+FolderModelItem* FolderModel::findItemByName(const char* name, int* row) {
+  // wrap the name without copying it, only for the hash lookup
+  FolderModelItem* item = nameIndex_.value(QByteArray::fromRawData(name, strlen(name)));
+  if(item)
+    *row = item->row;
+  return item;
+}
+
+FolderModelItem* FolderModel::findItemByFileInfo(FmFileInfo* info, int* row) {
+  FolderModelItem* item = infoIndex_.value(info);
+  if(item)
+    *row = item->row;
+  return item;
 }
 
 QStringList FolderModel::mimeTypes() const {
@@ -564,101 +768,301 @@ void FolderModel::releaseThumbnails(int size) {
       thumbnailRefCounts.erase(it);
 
       // remove thumbnails that ara queued for loading from thumbnailResults
-      QLinkedList<FmThumbnailLoader*>::iterator it;
+      QHash<ThumbnailRequest*, int>::iterator it;
       for(it = thumbnailResults.begin(); it != thumbnailResults.end();) {
-        QLinkedList<FmThumbnailLoader*>::iterator next = it + 1;
-        FmThumbnailLoader* res = *it;
-        if(ThumbnailLoader::size(res) == size) {
-          ThumbnailLoader::cancel(res);
-          thumbnailResults.erase(it);
+        if(it.value() == size) {
+          ThumbnailEngine::instance()->cancel(it.key());
+          it = thumbnailResults.erase(it);
         }
-        it = next;
+        else
+          ++it;
       }
 
-      // remove all cached thumbnails of the specified size
-      QList<FolderModelItem>::iterator itemIt;
-      for(itemIt = items.begin(); itemIt != items.end(); ++itemIt) {
-        FolderModelItem& item = *itemIt;
-        item.removeThumbnail(size);
-      }
+      // remove all cached thumbnails of the specified size, but keep the largest
+      // ones while other sizes are in use, they are derived from them
+      bool keepLargest = !thumbnailRefCounts.isEmpty();
+      store_.forEach([size, keepLargest](FolderModelItem& item) {
+        item.removeThumbnail(size, keepLargest);
+      });
     }
   }
 }
 
-void FolderModel::onThumbnailLoaded(FmThumbnailLoader* res, gpointer user_data) {
+// called by the ThumbnailEngine with all our thumbnails finished since the last call
+void FolderModel::onThumbnailLoaded(const QVector<ThumbnailRequest*>& requests, gpointer user_data) {
   FolderModel* pThis = reinterpret_cast<FolderModel*>(user_data);
-  QLinkedList<FmThumbnailLoader*>::iterator it;
-  for(it = pThis->thumbnailResults.begin(); it != pThis->thumbnailResults.end(); ++it) {
-    if(*it == res) { // the thumbnail result is in our list
-      pThis->thumbnailResults.erase(it); // remove it from the list
-      FmFileInfo* info = ThumbnailLoader::fileInfo(res);
-      int row = -1;
-      // find the model item this thumbnail belongs to
-      QList<FolderModelItem>::iterator it = pThis->findItemByFileInfo(info, &row);
-      if(it != pThis->items.end()) {
-        // the file is found in our model
-        FolderModelItem& item = *it;
-        QModelIndex index = pThis->createIndex(row, 0, (void*)&item);
-        // store the image in the folder model item.
-        int size = ThumbnailLoader::size(res);
-        QImage image = ThumbnailLoader::image(res);
-        FolderModelItem::Thumbnail* thumbnail = item.findThumbnail(size);
-        thumbnail->image = image;
-        // qDebug("thumbnail loaded for: %s, size: %d", item.displayName.toUtf8().constData(), size);
-        if(image.isNull())
-          thumbnail->status = FolderModelItem::ThumbnailFailed;
-        else {
-          thumbnail->status = FolderModelItem::ThumbnailLoaded;
-          // FIXME: due to bugs in Qt's QStyledItemDelegate, if the image width and height
-          // are not the same, painting errors will happen. It's quite unfortunate.
-          // Let's do some padding to make its width and height equals.
-          // This greatly decrease performance :-(
-          // Later if we can re-implement our own item delegate, this can be avoided.
-          QPixmap pixmap = QPixmap(size, size);
-          pixmap.fill(QColor(0, 0, 0, 0)); // fill the pixmap with transparent color (alpha:0)
-          QPainter painter(&pixmap);
-          int x = (size - image.width()) / 2;
-          int y = (size - image.height()) / 2;
-          painter.drawImage(QPoint(x, y), image); // draw the image to the pixmap at center.
-          // FIXME: should we cache QPixmap instead for performance reason?
-          thumbnail->image = pixmap.toImage(); // convert it back to image
-
-          // tell the world that we have the thumbnail loaded
-          Q_EMIT pThis->thumbnailLoaded(index, size);
-        }
+  qreal pixelRatio = qApp->devicePixelRatio();
+  Q_FOREACH(ThumbnailRequest* request, requests) {
+    QHash<ThumbnailRequest*, int>::iterator it = pThis->thumbnailResults.find(request);
+    if(it == pThis->thumbnailResults.end()) // not in our list
+      continue;
+    int size = it.value();
+    pThis->thumbnailResults.erase(it);
+    FmFileInfo* info = ThumbnailEngine::fileInfo(request);
+    int row = -1;
+    // find the model item this thumbnail belongs to
+    FolderModelItem* item = pThis->findItemByFileInfo(info, &row);
+    if(item) {
+      // the file is found in our model
+      QModelIndex index = pThis->createIndex(row, 0, item);
+      // store the image in the folder model item.
+      QImage image = ThumbnailEngine::image(request);
+      FolderModelItem::Thumbnail* thumbnail = item->findThumbnail(size);
+      // qDebug("thumbnail loaded for: %s, size: %d", item.displayName.toUtf8().constData(), size);
+      if(image.isNull())
+        thumbnail->status = FolderModelItem::ThumbnailFailed;
+      else {
+        // Convert it once here rather than every time it is painted. The item
+        // delegates centre thumbnails which are not square themselves.
+        QPixmap pixmap = QPixmap::fromImage(image);
+        pixmap.setDevicePixelRatio(pixelRatio);
+        // keyed by the mtime the thumbnail was made for, not the current one
+        // in case the file changed while it was being made
+        qint64 mtime = ThumbnailEngine::mtime(request);
+        thumbnail->handle = ThumbnailCache::instance()->insert(info, mtime, ThumbnailEngine::size(request), pixmap);
+        thumbnail->status = FolderModelItem::ThumbnailLoaded;
+
+        // tell the world that we have the thumbnail loaded
+        Q_EMIT pThis->thumbnailLoaded(index, size);
       }
-      break;
     }
   }
 }
 
 // get a thumbnail of size at the index
 // if a thumbnail is not yet loaded, this will initiate loading of the thumbnail.
-QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
+QPixmap FolderModel::thumbnailFromIndex(const QModelIndex& index, int size, int priority) {
   FolderModelItem* item = itemFromIndex(index);
   if(item) {
+    ThumbnailCache* cache = ThumbnailCache::instance();
     FolderModelItem::Thumbnail* thumbnail = item->findThumbnail(size);
+    if(thumbnail->status == FolderModelItem::ThumbnailLoaded) {
+      QPixmap pixmap = cache->pixmap(thumbnail->handle);
+      if(!pixmap.isNull())
+        return pixmap;
+      // evicted from the cache, load it again
+      thumbnail->status = FolderModelItem::ThumbnailNotChecked;
+    }
     // qDebug("FolderModel::thumbnailFromIndex: %d, %s", thumbnail->status, item->displayName.toUtf8().data());
     switch(thumbnail->status) {
       case FolderModelItem::ThumbnailNotChecked: {
-        // load the thumbnail
-        FmThumbnailLoader* res = ThumbnailLoader::load(item->info, size, onThumbnailLoaded, this);
-        thumbnailResults.push_back(res);
+        qreal pixelRatio = qApp->devicePixelRatio();
+        int pixelSize = qRound(size * pixelRatio);
+        // loaded before, maybe by the model of another view of the folder
+        thumbnail->handle = cache->find(item->info, pixelSize);
+        if(thumbnail->handle) {
+          thumbnail->status = FolderModelItem::ThumbnailLoaded;
+          return cache->pixmap(thumbnail->handle);
+        }
+        FolderModelItem::Thumbnail* larger;
+        QPixmap largerPixmap;
+        // skip the larger thumbnails which were evicted from the cache meanwhile
+        while((larger = item->findLargerThumbnail(size)) && larger->status == FolderModelItem::ThumbnailLoaded) {
+          largerPixmap = cache->pixmap(larger->handle);
+          if(!largerPixmap.isNull())
+            break;
+          larger->status = FolderModelItem::ThumbnailNotChecked;
+        }
+        if(larger) {
+          // scale down the larger thumbnail instead of going to the disk
+          if(larger->status == FolderModelItem::ThumbnailLoaded) {
+            QPixmap pixmap = QPixmap::fromImage(scaleThumbnail(largerPixmap.toImage(), pixelSize));
+            pixmap.setDevicePixelRatio(pixelRatio);
+            thumbnail->handle = cache->insertScaled(larger->handle, pixelSize, pixmap);
+            thumbnail->status = FolderModelItem::ThumbnailLoaded;
+            return pixmap;
+          }
+          if(larger->status == FolderModelItem::ThumbnailFailed) {
+            thumbnail->status = FolderModelItem::ThumbnailFailed;
+            break;
+          }
+          // still loading, thumbnailLoaded() is emitted with its size when it is done
+          break;
+        }
+        // load the thumbnail with enough pixels for high dpi screens
+        ThumbnailRequest* request = ThumbnailEngine::instance()->load(item->info, pixelSize, onThumbnailLoaded, this, priority);
+        thumbnailResults.insert(request, size);
         thumbnail->status = FolderModelItem::ThumbnailLoading;
         break;
       }
-      case FolderModelItem::ThumbnailLoaded:
-        return thumbnail->image;
       default:
         break;
     }
   }
-  return QImage();
+  return QPixmap();
+}
+
+void FolderModel::prioritizeThumbnails(const std::function<int(int row)>& priority) {
+  ThumbnailEngine* engine = ThumbnailEngine::instance();
+  QHash<ThumbnailRequest*, int>::iterator it;
+  for(it = thumbnailResults.begin(); it != thumbnailResults.end();) {
+    ThumbnailRequest* request = it.key();
+    int row = -1;
+    FolderModelItem* item = findItemByFileInfo(ThumbnailEngine::fileInfo(request), &row);
+    int newPriority = item ? priority(row) : -1;
+    if(newPriority < 0) {
+      engine->cancel(request);
+      // load it again when the row is painted the next time
+      if(item)
+        item->findThumbnail(it.value())->status = FolderModelItem::ThumbnailNotChecked;
+      it = thumbnailResults.erase(it);
+    }
+    else {
+      ThumbnailEngine::setPriority(request, newPriority);
+      ++it;
+    }
+  }
+  engine->updatePriorities();
 }
 
 void FolderModel::updateIcons() {
-  QList<FolderModelItem>::iterator it = items.begin();
-  for(;it != items.end(); ++it) {
-    (*it).updateIcon();
+  store_.forEach([](FolderModelItem& item) {
+    item.updateIcon();
+  });
+}
+
+// drop the cached data and thumbnails of the changed items,
+// they are computed again when the rows are painted.
+void FolderModel::invalidateChangedItems() {
+  Q_FOREACH(FolderModelItem* item, changedItems_) {
+    item->invalidate();
+  }
+  // a hot folder keeps showing the old thumbnail until it calms down
+  if(hotMode_)
+    staleThumbnails_.unite(changedItems_);
+  else
+    clearThumbnails(changedItems_);
+  changedItems_.clear();
+  changeTimer_->stop();
+}
+
+// Drop the thumbnails of the items, and cancel those still being made of
+// the files as they were before they changed.
+void FolderModel::clearThumbnails(const QSet<FolderModelItem*>& items) {
+  if(items.isEmpty())
+    return;
+  QSet<FmFileInfo*> infos;
+  Q_FOREACH(FolderModelItem* item, items) {
+    item->thumbnails.clear();
+    infos.insert(item->info);
+  }
+  QHash<ThumbnailRequest*, int>::iterator it;
+  for(it = thumbnailResults.begin(); it != thumbnailResults.end();) {
+    if(infos.contains(ThumbnailEngine::fileInfo(it.key()))) {
+      ThumbnailEngine::instance()->cancel(it.key());
+      it = thumbnailResults.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void FolderModel::flushChangedItems() {
+  if(changedItems_.isEmpty())
+    return;
+  QVector<int> rows;
+  rows.reserve(changedItems_.size());
+  Q_FOREACH(FolderModelItem* item, changedItems_) {
+    rows.append(item->row);
+  }
+  invalidateChangedItems();
+
+  // report runs of adjacent rows as one range
+  std::sort(rows.begin(), rows.end());
+  int first = 0;
+  while(first < rows.size()) {
+    int last = first;
+    while(last + 1 < rows.size() && rows[last + 1] == rows[last] + 1)
+      ++last;
+    Q_EMIT dataChanged(index(rows[first], 0), index(rows[last], NumOfColumns - 1));
+    first = last + 1;
+  }
+}
+
+// count file events of a loaded folder, the rate is checked by measureEventRate()
+void FolderModel::noteFolderEvents(FmFolder* folder, int count) {
+  // loading a folder is not churn
+  if(!fm_folder_is_loaded(folder))
+    return;
+  eventCount_ += count;
+  if(!rateTimer_->isActive())
+    rateTimer_->start();
+}
+
+void FolderModel::measureEventRate() {
+  int rate = eventCount_; // the timer fires once per second
+  eventCount_ = 0;
+  if(!hotMode_ && rate > hotEventRate_)
+    setHotMode(true);
+  else if(hotMode_ && rate < hotEventRate_ / 2) // leave it only well below the threshold
+    setHotMode(false);
+  if(!hotMode_ && rate == 0)
+    rateTimer_->stop();
+}
+
+void FolderModel::setHotMode(bool hot) {
+  hotMode_ = hot;
+  // in hot mode, changes and new files are handled in fixed windows
+  changeTimer_->setInterval(hot ? 500 : 16);
+  insertionTimer_->setInterval(hot ? 500 : 0);
+  if(!hot) {
+    // reload the thumbnails we kept while the folder was hot
+    clearThumbnails(staleThumbnails_);
+    changedItems_.unite(staleThumbnails_);
+    staleThumbnails_.clear();
+    if(!changedItems_.isEmpty() && !changeTimer_->isActive())
+      changeTimer_->start();
+  }
+
+  QString path;
+  if(folder_) {
+    char* pathStr = fm_path_to_str(fm_folder_get_path(folder_));
+    path = QString::fromUtf8(pathStr);
+    g_free(pathStr);
+  }
+  // qDebug() << "FolderModel: hot mode" << (hot ? "entered" : "left") << "for" << path;
+  Q_EMIT hotModeChanged(path, hot);
+}
+
+void FolderModel::ensureNameBuffer() {
+  if(namesValid_)
+    return;
+  names_.clear();
+  store_.forEach([this](FolderModelItem& item) {
+    names_.insert(item.slot, fm_file_info_get_name(item.info));
+  });
+  namesValid_ = true;
+}
+
+void FolderModel::matchNames(const QByteArray& foldedPattern, bool subsequence, QBitArray* matched, QBitArray* live) {
+  ensureNameBuffer();
+  names_.matchAll(foldedPattern, subsequence, matched, live);
+}
+
+bool FolderModel::nameMatches(FolderModelItem* item, const QByteArray& foldedPattern, bool subsequence) {
+  ensureNameBuffer();
+  return names_.matches(item->slot, foldedPattern, subsequence);
+}
+
+void FolderModel::onVolumeLabelResolved(const QString& device) {
+  updateMountPointNames(device);
+}
+
+void FolderModel::onVolumeLabelsInvalidated() {
+  updateMountPointNames(QString());
+}
+
+// recompute the names of the mount points showing device, or of all mount points if device is empty
+void FolderModel::updateMountPointNames(const QString& device) {
+  VolumeLabelResolver* resolver = VolumeLabelResolver::instance();
+  Q_FOREACH(FolderModelItem* item, mountPoints_) {
+    if(item->row < 0)
+      continue;
+    // the same device FolderModelItem::displayName() asks for
+    if(!device.isEmpty() && device != resolver->deviceForName(QString::fromUtf8(fm_file_info_get_disp_name(item->info))))
+      continue;
+    item->invalidate(FolderModelItem::CachedDisplayName);
+    QModelIndex index = createIndex(item->row, 0, item);
+    Q_EMIT dataChanged(index, index);
   }
 }
@@ -25,12 +25,21 @@
 #include <QAbstractListModel>
 #include <QIcon>
 #include <QImage>
+#include <QPixmap>
 #include <libfm/fm.h>
 #include <QList>
 #include <QVector>
-#include <QLinkedList>
 #include <QPair>
+#include <QHash>
+#include <QSet>
+#include <QByteArray>
+#include <functional>
 #include "foldermodelitem.h"
+#include "foldermodelitemstore.h"
+#include "namematcher.h"
+#include "thumbnailengine.h"
+
+class QTimer;
 
 namespace Fm {
 
@@ -86,43 +95,160 @@ public:
 
   FmFileInfo* fileInfoFromIndex(const QModelIndex& index) const;
   FolderModelItem* itemFromIndex(const QModelIndex& index) const;
-  QImage thumbnailFromIndex(const QModelIndex& index, int size);
+  // priority orders the load against the other queued thumbnails, lower first
+  QPixmap thumbnailFromIndex(const QModelIndex& index, int size, int priority = 0);
 
   void cacheThumbnails(int size);
   void releaseThumbnails(int size);
 
+  // Reorder the queued thumbnail loads, usually by distance from the visible
+  // rows. priority is called with the row of each item still waiting for its
+  // thumbnail and returns the new priority, or -1 to cancel the load.
+  void prioritizeThumbnails(const std::function<int(int row)>& priority);
+
   void wantToSelect(QStringList files, bool add, void *view);
 
+  // when more than this fraction of the rows is removed at once,
+  // the model is reset instead of emitting many row removals.
+  qreal removalResetRatio() const {
+    return removalResetRatio_;
+  }
+
+  void setRemovalResetRatio(qreal ratio) {
+    removalResetRatio_ = ratio;
+  }
+
+  // maximum time in milliseconds spent inserting new files
+  // before returning to the event loop
+  int insertionTimeSlice() const {
+    return insertionTimeSlice_;
+  }
+
+  void setInsertionTimeSlice(int msec) {
+    insertionTimeSlice_ = msec;
+  }
+
+  // number of file events per second above which the folder is considered hot.
+  // Hot folders batch their updates and do not regenerate thumbnails.
+  int hotEventRate() const {
+    return hotEventRate_;
+  }
+
+  void setHotEventRate(int rate) {
+    hotEventRate_ = rate;
+  }
+
+  bool isHot() const {
+    return hotMode_;
+  }
+
+  // true if some files of the folder are not inserted into the model yet
+  bool hasQueuedFiles() const {
+    return pendingPos_ < queuedFiles_.size();
+  }
+
+  // true until the folders are loaded and all their files are inserted
+  bool isLoading() const;
+
+  // Match a pattern folded with foldName() against the file names of all
+  // items. See NameBuffer::matchAll(), the bits are indexed by FolderModelItem::slot.
+  void matchNames(const QByteArray& foldedPattern, bool subsequence, QBitArray* matched, QBitArray* live);
+  bool nameMatches(FolderModelItem* item, const QByteArray& foldedPattern, bool subsequence);
+
 Q_SIGNALS:
+  // sizes smaller than size can now be derived from it as well
   void thumbnailLoaded(const QModelIndex& index, int size);
+  // emitted after every slice of files inserted into the model
+  void insertionProgress(int inserted, int total);
+  void loadingStarted();
+  // emitted when a folder finished loading and its files are all inserted
+  void loadingFinished();
+  // emitted when the folder enters or leaves the hot mode, for debugging
+  void hotModeChanged(const QString& folderPath, bool hot);
 
 public Q_SLOTS:
   void updateIcons();
 
+protected Q_SLOTS:
+  void insertQueuedFiles();
+  void flushChangedItems();
+  void measureEventRate();
+  void onVolumeLabelResolved(const QString& device);
+  void onVolumeLabelsInvalidated();
+
 protected:
   static void onStartLoading(FmFolder* folder, gpointer user_data);
   static void onFinishLoading(FmFolder* folder, gpointer user_data);
   static void onFilesAdded(FmFolder* folder, GSList* files, gpointer user_data);
   static void onFilesChanged(FmFolder* folder, GSList* files, gpointer user_data);
   static void onFilesRemoved(FmFolder* folder, GSList* files, gpointer user_data);
-  static void onThumbnailLoaded(FmThumbnailLoader *res, gpointer user_data);
+  static void onThumbnailLoaded(const QVector<ThumbnailRequest*>& requests, gpointer user_data);
 
   void onFinishedLoading();
-  void insertFiles(int row, FmFileInfoList* files);
+  void insertFiles(FmFileInfoList* files);
+  void queueFile(FmFileInfo* info);
+  void unqueueFiles(GSList* files);
+  void clearQueuedFiles();
+  void removeItems(QVector<int>& rows);
   void removeAll();
-  QList<FolderModelItem>::iterator findItemByPath(FmPath* path, int* row);
-  QList<FolderModelItem>::iterator findItemByName(const char* name, int* row);
-  QList<FolderModelItem>::iterator findItemByFileInfo(FmFileInfo* info, int* row);
+  FolderModelItem* findItemByPath(FmPath* path, int* row);
+  FolderModelItem* findItemByName(const char* name, int* row);
+  FolderModelItem* findItemByFileInfo(FmFileInfo* info, int* row);
+
+private:
+  FolderModelItem* createItem(FmFileInfo* info);
+  void destroyItem(FolderModelItem* item);
+  void indexItem(FolderModelItem* item);
+  void rebuildIndex();
+  void updateRows(int row);
+  void updateMountPointNames(const QString& device);
+  void invalidateChangedItems();
+  void clearThumbnails(const QSet<FolderModelItem*>& items);
+  void ensureNameBuffer();
+  void noteFolderEvents(FmFolder* folder, int count);
+  void setHotMode(bool hot);
 
 private:
   FmFolder* folder_;
   FmFolder* computerFolder_; // the items added for drives on the desktop
-  // FIXME: should we use a hash table here so item lookup becomes much faster?
-  QList<FolderModelItem> items;
+  FolderModelItemStore store_; // owns the items, pointers to them are stable
+  QVector<FolderModelItem*> items; // items in the order of rows
+
+  // hash tables mapping file names and FmFileInfo pointers to items.
+  // They are updated on every insertion and removal so lookups of changed,
+  // removed or thumbnailed files do not need to walk the whole list.
+  // Items of the computer folder may have the same name as a file.
+  QMultiHash<QByteArray, FolderModelItem*> nameIndex_;
+  QHash<FmFileInfo*, FolderModelItem*> infoIndex_;
+  QSet<FolderModelItem*> mountPoints_; // the few items updated when volume labels are found
+  qreal removalResetRatio_;
+
+  // files waiting to be inserted in time slices, see insertQueuedFiles()
+  QVector<FmFileInfo*> queuedFiles_;
+  int pendingPos_; // index of the first file in queuedFiles_ not inserted yet
+  int insertedCount_; // files inserted since the queue was last empty
+  int insertionTimeSlice_;
+  QTimer* insertionTimer_;
+  bool finishLoadingPending_;
+
+  // changed items waiting to be invalidated and reported, see flushChangedItems()
+  QSet<FolderModelItem*> changedItems_;
+  QTimer* changeTimer_;
+
+  // detection of folders changing all the time, see measureEventRate()
+  int hotEventRate_;
+  int eventCount_; // events since the last measurement
+  bool hotMode_;
+  QTimer* rateTimer_;
+  QSet<FolderModelItem*> staleThumbnails_; // changed while hot, reloaded when calm again
+
+  // case folded file names for the quick filter, only built once it is used
+  NameBuffer names_;
+  bool namesValid_;
 
   // record what size of thumbnails we should cache in an array of <size, refCount> pairs.
   QVector<QPair<int, int> > thumbnailRefCounts;
-  QLinkedList<FmThumbnailLoader*> thumbnailResults;
+  QHash<ThumbnailRequest*, int> thumbnailResults; // queued in the ThumbnailEngine, with their size in device independent pixels
 
   // for "ShowItems"
   QStringList filesToSelect;
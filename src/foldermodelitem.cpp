@@ -21,98 +21,284 @@
 #include "foldermodelitem.h"
 #include <QFileInfo>
 #include <QDebug>
-#include <QProcess>
+#include <QCollator>
+#include <QHash>
+#include <string.h>
+#include <utility>
+#include <algorithm>
+#include <pwd.h>
 #include "bundle.h"
+#include "volumelabelresolver.h"
 
 using namespace Fm;
 
 FolderModelItem::FolderModelItem(FmFileInfo* _info):
-  info(fm_file_info_ref(_info)) {
-  displayName = QString::fromUtf8(fm_file_info_get_disp_name(info));
-  // qDebug() << "probono: (1) FolderModelItem created for" << displayName;
+  info(fm_file_info_ref(_info)),
+  row(-1),
+  slot(-1),
+  cached_(0),
+  isAppDirOrBundle_(false),
+  hidden_(false),
+  sortKeys_() {
+  // Only the bundle check is done right away, it renames the file info and
+  // everything reading the display name has to see the new one. The rest is
+  // computed when needed, see displayName(), icon() and friends.
+  isAppDirOrBundle();
+  thumbnails.reserve(2);
+}
 
-  bool isAppDirOrBundle = checkWhetherAppDirOrBundle(_info);
+FolderModelItem::FolderModelItem(FolderModelItem&& other):
+  info(other.info),
+  thumbnails(std::move(other.thumbnails)),
+  row(other.row),
+  slot(other.slot),
+  cached_(other.cached_),
+  isAppDirOrBundle_(other.isAppDirOrBundle_),
+  hidden_(other.hidden_),
+  displayName_(std::move(other.displayName_)),
+  icon_(std::move(other.icon_)),
+  mimeDesc_(std::move(other.mimeDesc_)),
+  mtime_(std::move(other.mtime_)),
+  size_(std::move(other.size_)),
+  owner_(std::move(other.owner_)),
+  sortKeys_(other.sortKeys_),
+  nameSortKey_(std::move(other.nameSortKey_)),
+  nameSortKeyCase_(std::move(other.nameSortKeyCase_)) {
+  other.info = NULL;
+  other.cached_ = 0;
+}
 
-  icon = IconTheme::icon(fm_file_info_get_icon(_info));
+FolderModelItem& FolderModelItem::operator=(FolderModelItem&& other) {
+  if(this != &other) {
+    if(info)
+      fm_file_info_unref(info);
+    info = other.info;
+    other.info = NULL;
+    thumbnails = std::move(other.thumbnails);
+    row = other.row;
+    slot = other.slot;
+    cached_ = other.cached_;
+    other.cached_ = 0;
+    isAppDirOrBundle_ = other.isAppDirOrBundle_;
+    hidden_ = other.hidden_;
+    displayName_ = std::move(other.displayName_);
+    icon_ = std::move(other.icon_);
+    mimeDesc_ = std::move(other.mimeDesc_);
+    mtime_ = std::move(other.mtime_);
+    size_ = std::move(other.size_);
+    owner_ = std::move(other.owner_);
+    sortKeys_ = other.sortKeys_;
+    nameSortKey_ = std::move(other.nameSortKey_);
+    nameSortKeyCase_ = std::move(other.nameSortKeyCase_);
+  }
+  return *this;
+}
 
-  // probono: Set some things differently for AppDir/app bundle than for normal folder
-  if(isAppDirOrBundle) {
+FolderModelItem::~FolderModelItem() {
+  if(info)
+    // qDebug("probono: FolderModelItem destroyed for");
+    // qDebug(fm_file_info_get_disp_name(info));
+    fm_file_info_unref(info);
+
+}
+
+// only names ending in .app or .AppDir can be bundles, see checkWhetherAppDirOrBundle()
+static bool hasBundleSuffix(const char* name) {
+  size_t len = strlen(name);
+  return (len > 4 && g_ascii_strcasecmp(name + len - 4, ".app") == 0)
+         || (len > 7 && g_ascii_strcasecmp(name + len - 7, ".appdir") == 0);
+}
 
+bool FolderModelItem::isAppDirOrBundle() {
+  if(!(cached_ & CachedBundle)) {
+    // probono: Set some things differently for AppDir/app bundle than for normal folder
+    // checking the name first spares looking at the disk for all other folders
+    isAppDirOrBundle_ = hasBundleSuffix(fm_file_info_get_name(info)) && checkWhetherAppDirOrBundle(info);
+    if(isAppDirOrBundle_) {
       QString path = QString(fm_path_to_str(fm_file_info_get_path(info)));
       QFileInfo fileInfo = QFileInfo(path);
       QString nameWithoutSuffix = QFileInfo(fileInfo.completeBaseName()).fileName();
 
       qDebug() << "probono: AppDir/app bundle detected:" << path;
 
-      qDebug() << "probono: Set different icon for AppDir/app bundle";
-      icon = getIconForBundle(info);
-
       // probono: Set display name
-      fm_file_info_set_disp_name(_info, nameWithoutSuffix.toUtf8()); // probono: Remove the suffix from display name
+      fm_file_info_set_disp_name(info, nameWithoutSuffix.toUtf8()); // probono: Remove the suffix from display name
       qDebug() << "probono: TODO: Set the proper display name for AppDir based on Name= entries in desktop file. Similar to what happens when desktop files are displayed";
 
       qDebug() << "probono: TODO: Submit it to some Launch Services like database?";
+    }
+    cached_ |= CachedBundle;
+  }
+  return isAppDirOrBundle_;
+}
+
+const QString& FolderModelItem::displayName() {
+  if(!(cached_ & CachedDisplayName)) {
+    displayName_ = QString::fromUtf8(fm_file_info_get_disp_name(info));
+
+    if (displayName_ == "File System") {
+      displayName_ = "Startvolume";
+    }
 
+    if(isMountPoint()) {
+      // show the volume label instead of the device name once it is known.
+      // FolderModel invalidates the name when the lookup finishes.
+      // NOTE: placesmodelitem.cpp does the same for what gets shown in the sidebar
+      VolumeLabelResolver* resolver = VolumeLabelResolver::instance();
+      QString label;
+      if(resolver && resolver->label(resolver->deviceForName(displayName_), &label) && !label.isEmpty())
+        displayName_ = label;
+    }
+    cached_ |= CachedDisplayName;
   }
+  return displayName_;
+}
 
-  thumbnails.reserve(2);
+bool FolderModelItem::isMountPoint() const {
+  const char* mimetype = fm_mime_type_get_type(fm_file_info_get_mime_type(info));
+  return mimetype && strcmp(mimetype, "inode/mount-point") == 0;
+}
 
+const FolderModelItem::SortKeys& FolderModelItem::sortKeys() {
+  if(!(cached_ & CachedSortKeys)) {
+    sortKeys_.mtime = fm_file_info_get_mtime(info);
+    sortKeys_.size = fm_file_info_get_size(info);
+    sortKeys_.uid = (qint32)fm_file_info_get_uid(info);
+    sortKeys_.mimeId = mimeTypeId(fm_file_info_get_mime_type(info));
+    sortKeys_.isDir = fm_file_info_is_dir(info);
+    cached_ |= CachedSortKeys;
+  }
+  return sortKeys_;
 }
 
-FolderModelItem::FolderModelItem(const FolderModelItem& other) {
-  info = other.info ? fm_file_info_ref(other.info) : NULL;
-  displayName = QString::fromUtf8(fm_file_info_get_disp_name(info));
-
-  if (displayName == "File System") {
-    displayName = "Startvolume";
-  }
-
-  QString mimetype;
-  mimetype = QString::fromUtf8(fm_mime_type_get_type(fm_mime_type_ref(fm_file_info_get_mime_type(info))));
-  if (mimetype == "inode/mount-point") {
-    qDebug() << "probono: Get the 'Volume label' for the volume";
-#ifdef __FreeBSD__
-    qDebug() << "probono: Using 'fstyp -l /dev/" + displayName + "' on FreeBSD";
-    // NOTE: placesmodelitem.cpp has similar code for what gets shown in the sidebar
-    // NOTE: Alternatively, we could just use mountpoints that have the volume label as their name
-    QProcess p;
-    QString program = "fstyp";
-    QStringList arguments;
-    arguments << "-l" << "/dev/" + displayName;
-    p.start(program, arguments);
-    p.waitForFinished();
-    QString result(p.readAllStandardOutput());
-    result.replace("\n", "");
-    result = result.trimmed();
-    qDebug() << "probono: result:" << result;
-    if (result.split(" ").length() == 1) {
-        if (result.split(" ")[0] != "" && result.split(" ")[0] != nullptr) {
-            // We got a filesystem but no volume label back, so use the filesystem
-            displayName = result.split(" ")[0];
-        }
-    } else if (result.split(" ").length() == 2) {
-        if (result.split(" ")[1] != "" && result.split(" ")[1] != nullptr) {
-            // We got a filesystem and a volume label back, so use the volume label
-            displayName = result.split(" ")[1];
-        }
+const QCollatorSortKey& FolderModelItem::nameSortKey(const QCollator& collator) {
+  bool caseSensitive = collator.caseSensitivity() == Qt::CaseSensitive;
+  int flag = caseSensitive ? CachedNameSortKeyCase : CachedNameSortKey;
+  std::unique_ptr<QCollatorSortKey>& key = caseSensitive ? nameSortKeyCase_ : nameSortKey_;
+  if(!(cached_ & flag)) {
+    // QCollatorSortKey cannot be assigned, so a new one replaces the outdated key
+    key.reset(new QCollatorSortKey(collator.sortKey(QString::fromUtf8(fm_file_info_get_disp_name(info)))));
+    cached_ |= flag;
+  }
+  return *key;
+}
+
+// the mime types seen so far, indexed by the ids handed out by mimeTypeId()
+static QHash<FmMimeType*, int> mimeTypeIds;
+static QVector<FmMimeType*> mimeTypes;
+static QVector<int> mimeTypeRanks; // empty if a type was added since they were computed
+
+//static
+int FolderModelItem::mimeTypeId(FmMimeType* mimeType) {
+  // libfm shares one FmMimeType object per type, so the pointer identifies it
+  if(!mimeType)
+    return -1;
+  QHash<FmMimeType*, int>::const_iterator it = mimeTypeIds.constFind(mimeType);
+  if(it != mimeTypeIds.constEnd())
+    return it.value();
+  int id = mimeTypes.size();
+  // keep the object alive so its address is not reused for another type
+  mimeTypeIds.insert(fm_mime_type_ref(mimeType), id);
+  mimeTypes.append(mimeType);
+  mimeTypeRanks.clear();
+  return id;
+}
+
+//static
+void FolderModelItem::updateMimeTypeRanks() {
+  if(mimeTypeRanks.size() == mimeTypes.size())
+    return;
+  // there are only a few hundred types at most, so this is cheap
+  QVector<QString> descs;
+  QVector<int> order;
+  descs.reserve(mimeTypes.size());
+  order.reserve(mimeTypes.size());
+  for(int id = 0; id < mimeTypes.size(); ++id) {
+    descs.append(QString::fromUtf8(fm_mime_type_get_desc(mimeTypes[id])));
+    order.append(id);
+  }
+  std::stable_sort(order.begin(), order.end(), [&descs](int a, int b) {
+    return QString::localeAwareCompare(descs[a], descs[b]) < 0;
+  });
+  mimeTypeRanks.resize(mimeTypes.size());
+  for(int rank = 0; rank < order.size(); ++rank)
+    mimeTypeRanks[order[rank]] = rank;
+}
+
+//static
+int FolderModelItem::mimeTypeRank(int mimeId) {
+  if(mimeId < 0)
+    return -1;
+  updateMimeTypeRanks();
+  return mimeTypeRanks[mimeId];
+}
+
+//static
+const QString& FolderModelItem::userName(qint32 uid) {
+  static QHash<qint32, QString> names;
+  QHash<qint32, QString>::iterator it = names.find(uid);
+  if(it == names.end()) {
+    QString name;
+    if(uid >= 0) {
+      struct passwd* pw = getpwuid(uid_t(uid));
+      name = pw ? QString::fromLocal8Bit(pw->pw_name) : QString::number(uid);
     }
-#else
-    qDebug() << "probono: TODO: To be implemented for this OS";
-#endif
+    it = names.insert(uid, name);
   }
+  return it.value();
+}
 
-  // qDebug() << "probono: (2) FolderModelItem created for" << displayName;
+bool FolderModelItem::checkHidden() const {
+  const char* name = fm_file_info_get_disp_name(info);
+  size_t len = name ? strlen(name) : 0;
+  return len > 0 && (name[0] == '.' || name[len - 1] == '~');
+}
 
-  icon = other.icon;
-  thumbnails = other.thumbnails;
+const QIcon& FolderModelItem::icon() {
+  if(!(cached_ & CachedIcon)) {
+    if(isAppDirOrBundle()) {
+      qDebug() << "probono: Set different icon for AppDir/app bundle";
+      icon_ = getIconForBundle(info);
+    }
+    else
+      icon_ = IconTheme::icon(fm_file_info_get_icon(info));
+    cached_ |= CachedIcon;
+  }
+  return icon_;
 }
 
-FolderModelItem::~FolderModelItem() {
-  if(info)
-    // qDebug("probono: FolderModelItem destroyed for");
-    // qDebug(fm_file_info_get_disp_name(info));
-    fm_file_info_unref(info);
+const QString& FolderModelItem::mimeDescription() {
+  if(!(cached_ & CachedMimeDesc)) {
+    FmMimeType* mime = fm_file_info_get_mime_type(info);
+    mimeDesc_ = QString::fromUtf8(fm_mime_type_get_desc(mime));
+    cached_ |= CachedMimeDesc;
+  }
+  return mimeDesc_;
+}
+
+const QString& FolderModelItem::dispMTime() {
+  if(!(cached_ & CachedMTime)) {
+    mtime_ = QString::fromUtf8(fm_file_info_get_disp_mtime(info));
+    cached_ |= CachedMTime;
+  }
+  return mtime_;
+}
+
+const QString& FolderModelItem::dispSize() {
+  if(!(cached_ & CachedSize)) {
+    size_ = QString::fromUtf8(fm_file_info_get_disp_size(info));
+    cached_ |= CachedSize;
+  }
+  return size_;
+}
 
+const QString& FolderModelItem::dispOwner() {
+  if(!(cached_ & CachedOwner)) {
+    // owners are shared by many files, look each of them up only once
+    owner_ = userName(sortKeys().uid);
+    cached_ |= CachedOwner;
+  }
+  return owner_;
 }
 
 // find thumbnail of the specified size
@@ -130,16 +316,35 @@ FolderModelItem::Thumbnail* FolderModelItem::findThumbnail(int size) {
     Thumbnail thumbnail;
     thumbnail.status = ThumbnailNotChecked;
     thumbnail.size = size;
+    thumbnail.handle = 0;
     thumbnails.append(thumbnail);
   }
   return &thumbnails.back();
 }
 
+FolderModelItem::Thumbnail* FolderModelItem::findLargerThumbnail(int size) {
+  Thumbnail* larger = NULL;
+  QVector<Thumbnail>::iterator it;
+  for(it = thumbnails.begin(); it != thumbnails.end(); ++it) {
+    if(it->size > size && it->status != ThumbnailNotChecked && (!larger || it->size < larger->size))
+      larger = it;
+  }
+  return larger;
+}
+
 // remove cached thumbnail of the specified size
-void FolderModelItem::removeThumbnail(int size) {
+void FolderModelItem::removeThumbnail(int size, bool keepIfLargest) {
   QVector<Thumbnail>::iterator it;
   for(it = thumbnails.begin(); it != thumbnails.end(); ++it) {
     if(it->size == size) { // an image of the same size is found
+      if(keepIfLargest && it->status == ThumbnailLoaded) {
+        Q_FOREACH(const Thumbnail& thumbnail, thumbnails) {
+          if(thumbnail.size > size && thumbnail.status == ThumbnailLoaded)
+            keepIfLargest = false;
+        }
+        if(keepIfLargest)
+          break;
+      }
       thumbnails.erase(it);
       break;
     }
@@ -148,11 +353,11 @@ void FolderModelItem::removeThumbnail(int size) {
 
 #if 0
 // cache the thumbnail of the specified size in the folder item
-void FolderModelItem::setThumbnail(int size, QImage image) {
+void FolderModelItem::setThumbnail(int size, ThumbnailCache::Handle handle) {
   QVector<Thumbnail>::iterator it;
   for(it = thumbnails.begin(); it != thumbnails.end(); ++it) {
     if(it->size == size) { // an image of the same size already exists
-      it->image = image; // replace it
+      it->handle = handle; // replace it
       it->status = ThumbnailLoaded;
       break;
     }
@@ -161,7 +366,7 @@ void FolderModelItem::setThumbnail(int size, QImage image) {
     Thumbnail thumbnail;
     thumbnail.size = size;
     thumbnail.status = ThumbnailLoaded;
-    thumbnail.image = image;
+    thumbnail.handle = handle;
     thumbnails.append(thumbnail); // add a new entry
   }
 }
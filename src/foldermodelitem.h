@@ -24,10 +24,16 @@
 #include "libfmqtglobals.h"
 #include <libfm/fm.h>
 #include <QImage>
+#include <QPixmap>
 #include <QString>
 #include <QIcon>
 #include <QVector>
+#include <memory>
 #include "icontheme.h"
+#include "thumbnailcache.h"
+
+class QCollator;
+class QCollatorSortKey;
 
 namespace Fm {
 
@@ -44,26 +50,124 @@ public:
   struct Thumbnail {
     int size;
     ThumbnailStatus status;
-    QImage image;
+    // the pixmap in the ThumbnailCache if loaded, it is loaded again once evicted
+    ThumbnailCache::Handle handle;
+  };
+
+  // Attributes shown by the views are only computed when they are first
+  // requested, normally while painting the row, and then cached in the item.
+  // These flags record which of them are cached.
+  enum CachedData {
+    CachedBundle = 1 << 0,
+    CachedDisplayName = 1 << 1,
+    CachedIcon = 1 << 2,
+    CachedMimeDesc = 1 << 3,
+    CachedMTime = 1 << 4,
+    CachedSize = 1 << 5,
+    CachedOwner = 1 << 6,
+    CachedSortKeys = 1 << 7,
+    CachedNameSortKey = 1 << 8,
+    CachedNameSortKeyCase = 1 << 9,
+    CachedHidden = 1 << 10,
+    CachedAll = 0xffff
+  };
+
+  // Values compared by ProxyFolderModel::lessThan(). They are packed together
+  // so a sort reads them straight from the item without calling into libfm.
+  struct SortKeys {
+    qint64 mtime;
+    qint64 size;
+    qint32 uid; // -1 if unknown, e.g. for the devices on the desktop
+    qint32 mimeId; // see mimeTypeId()
+    bool isDir;
   };
 
 public:
   FolderModelItem(FmFileInfo* _info);
-  FolderModelItem(const FolderModelItem& other);
+  // items are only ever moved, by FolderModelItemStore::compact(). Moving
+  // steals the file info and the cached data without touching libfm.
+  FolderModelItem(FolderModelItem&& other);
+  FolderModelItem& operator=(FolderModelItem&& other);
   virtual ~FolderModelItem();
 
   Thumbnail* findThumbnail(int size);
-  // void setThumbnail(int size, QImage image);
-  void removeThumbnail(int size);
+  // the smallest thumbnail larger than size which is loaded, loading or failed,
+  // smaller sizes are derived from it instead of being loaded again
+  Thumbnail* findLargerThumbnail(int size);
+  // void setThumbnail(int size, ThumbnailCache::Handle handle);
+  // if keepIfLargest is true, a loaded thumbnail is kept when it is the largest one
+  void removeThumbnail(int size, bool keepIfLargest = false);
+
+  const QString& displayName();
+  const QIcon& icon();
+  const QString& mimeDescription();
+  const QString& dispMTime();
+  const QString& dispSize();
+  const QString& dispOwner();
+
+  // forget cached attributes so they are computed again on next access
+  void invalidate(int what = CachedAll) {
+    cached_ &= ~what;
+    // libfm resets the display name of a changed bundle, strip the suffix again
+    if(what & CachedBundle)
+      isAppDirOrBundle();
+  }
 
   void updateIcon() {
-    icon = IconTheme::icon(fm_file_info_get_icon(info));
+    invalidate(CachedIcon);
   }
 
-  QString displayName;
-  QIcon icon;
+  bool isMountPoint() const;
+
+  // dot files and backup files ending with "~"
+  bool isHidden() {
+    if(!(cached_ & CachedHidden)) {
+      hidden_ = checkHidden();
+      cached_ |= CachedHidden;
+    }
+    return hidden_;
+  }
+
+  const SortKeys& sortKeys();
+  // Natural order sort key of the name made with collator. The keys of a case
+  // sensitive and a case insensitive collator are cached separately.
+  const QCollatorSortKey& nameSortKey(const QCollator& collator);
+
+  // small integer identifying the mime type, the same for all items of a type
+  static int mimeTypeId(FmMimeType* mimeType);
+  // position of the type when all types seen so far are ordered by description
+  static int mimeTypeRank(int mimeId);
+  // make sure mimeTypeRank() does not need to change anything, so that it
+  // can be called from other threads
+  static void updateMimeTypeRanks();
+
+  // name of the user, cached so each uid is only looked up once
+  static const QString& userName(qint32 uid);
+
   FmFileInfo* info;
   QVector<Thumbnail> thumbnails;
+  int row; // current row in FolderModel, kept up to date by the model
+  int slot; // storage slot in FolderModelItemStore
+
+private:
+  bool isAppDirOrBundle();
+  bool checkHidden() const;
+
+  Q_DISABLE_COPY(FolderModelItem)
+
+private:
+  int cached_;
+  bool isAppDirOrBundle_;
+  bool hidden_;
+  QString displayName_;
+  QIcon icon_;
+  QString mimeDesc_;
+  QString mtime_;
+  QString size_;
+  QString owner_;
+  SortKeys sortKeys_;
+  std::unique_ptr<QCollatorSortKey> nameSortKey_;
+  std::unique_ptr<QCollatorSortKey> nameSortKeyCase_;
 };
 
 }
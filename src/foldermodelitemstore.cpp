@@ -0,0 +1,108 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "foldermodelitemstore.h"
+#include <new>
+#include <utility>
+#include <string.h>
+
+using namespace Fm;
+
+FolderModelItemStore::FolderModelItemStore():
+  size_(0) {
+}
+
+FolderModelItemStore::~FolderModelItemStore() {
+  clear();
+}
+
+int FolderModelItemStore::allocSlot() {
+  if(!freeSlots_.isEmpty()) {
+    int slot = freeSlots_.last();
+    freeSlots_.removeLast();
+    return slot;
+  }
+  // no tombstones left, add a new chunk and put all but its first slot on the free list
+  Chunk* chunk = new Chunk;
+  memset(chunk->used, 0, sizeof(chunk->used));
+  int first = chunks_.size() * ChunkSize;
+  chunks_.append(chunk);
+  // push in reverse order so the slots are handed out from the front of the chunk
+  for(int slot = first + ChunkSize - 1; slot > first; --slot)
+    freeSlots_.append(slot);
+  return first;
+}
+
+FolderModelItem* FolderModelItemStore::create(FmFileInfo* info) {
+  int slot = allocSlot();
+  FolderModelItem* item = new(slotAddress(slot)) FolderModelItem(info);
+  item->slot = slot;
+  chunks_[slot / ChunkSize]->used[slot % ChunkSize] = true;
+  ++size_;
+  return item;
+}
+
+void FolderModelItemStore::destroy(FolderModelItem* item) {
+  int slot = item->slot;
+  Q_ASSERT(chunks_[slot / ChunkSize]->used[slot % ChunkSize]);
+  item->~FolderModelItem();
+  chunks_[slot / ChunkSize]->used[slot % ChunkSize] = false;
+  freeSlots_.append(slot);
+  --size_;
+}
+
+void FolderModelItemStore::clear() {
+  forEach([](FolderModelItem& item) {
+    item.~FolderModelItem();
+  });
+  freeAll();
+}
+
+void FolderModelItemStore::freeAll() {
+  Q_FOREACH(Chunk* chunk, chunks_) {
+    delete chunk;
+  }
+  chunks_.clear();
+  freeSlots_.clear();
+  size_ = 0;
+}
+
+void FolderModelItemStore::compact(QVector<FolderModelItem*>& rows) {
+  Q_ASSERT(rows.size() == size_);
+  QVector<Chunk*> oldChunks = chunks_;
+  chunks_.clear();
+  freeSlots_.clear();
+  size_ = 0;
+
+  // move the items into fresh chunks in row order, so iterating over the
+  // store afterwards also walks the memory sequentially
+  for(int row = 0; row < rows.size(); ++row) {
+    FolderModelItem* oldItem = rows[row];
+    int slot = allocSlot();
+    FolderModelItem* item = new(slotAddress(slot)) FolderModelItem(std::move(*oldItem));
+    item->slot = slot;
+    chunks_[slot / ChunkSize]->used[slot % ChunkSize] = true;
+    ++size_;
+    oldItem->~FolderModelItem();
+    rows[row] = item;
+  }
+
+  Q_FOREACH(Chunk* chunk, oldChunks) {
+    delete chunk;
+  }
+}
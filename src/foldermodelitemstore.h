@@ -0,0 +1,104 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_FOLDERMODELITEMSTORE_H
+#define FM_FOLDERMODELITEMSTORE_H
+
+#include "libfmqtglobals.h"
+#include <libfm/fm.h>
+#include <QVector>
+#include "foldermodelitem.h"
+
+namespace Fm {
+
+// Storage of the FolderModelItem objects of a FolderModel.
+// Items are constructed in place inside fixed-size chunks which are never
+// reallocated, so a pointer to an item stays valid until the item itself is
+// destroyed. Destroying an item only marks its slot as free (a tombstone),
+// and the slot is reused by the next item created. compact() moves the live
+// items together again once too many slots are unused.
+class LIBFM_QT_API FolderModelItemStore {
+public:
+  FolderModelItemStore();
+  ~FolderModelItemStore();
+
+  FolderModelItem* create(FmFileInfo* info);
+  void destroy(FolderModelItem* item);
+  void clear();
+
+  // number of live items
+  int size() const {
+    return size_;
+  }
+
+  bool isEmpty() const {
+    return size_ == 0;
+  }
+
+  // true if more slots are free than used, and compact() is worth it
+  bool isFragmented() const {
+    return freeSlots_.size() > ChunkSize && freeSlots_.size() > size_;
+  }
+
+  // Move the live items into as few chunks as possible, in the order given by rows.
+  // rows must contain all live items and its pointers are updated in place.
+  // All other pointers to items become invalid.
+  void compact(QVector<FolderModelItem*>& rows);
+
+  // call func for every live item, in the order the items are laid out in memory
+  template<typename Func> void forEach(Func func) {
+    for(int c = 0; c < chunks_.size(); ++c) {
+      Chunk* chunk = chunks_[c];
+      for(int i = 0; i < ChunkSize; ++i) {
+        if(chunk->used[i])
+          func(*chunk->item(i));
+      }
+    }
+  }
+
+private:
+  enum {
+    ChunkSize = 256 // number of items in a chunk
+  };
+
+  struct Chunk {
+    FolderModelItem* item(int i) {
+      return reinterpret_cast<FolderModelItem*>(slots + i * sizeof(FolderModelItem));
+    }
+    bool used[ChunkSize];
+    alignas(FolderModelItem) char slots[ChunkSize * sizeof(FolderModelItem)];
+  };
+
+  FolderModelItem* slotAddress(int slot) {
+    return chunks_[slot / ChunkSize]->item(slot % ChunkSize);
+  }
+
+  int allocSlot();
+  void freeAll();
+
+  Q_DISABLE_COPY(FolderModelItemStore)
+
+private:
+  QVector<Chunk*> chunks_;
+  QVector<int> freeSlots_; // tombstones, reused before new chunks are allocated
+  int size_;
+};
+
+}
+
+#endif // FM_FOLDERMODELITEMSTORE_H
@@ -390,6 +390,8 @@ FolderView::FolderView(ViewMode _mode, QWidget* parent):
   autoSelectionDelay_(600),
   autoSelectionTimer_(NULL),
   selChangedTimer_(NULL),
+  thumbnailViewportTimer_(NULL),
+  lastScrollPos_(0),
   fileLauncher_(NULL),
   model_(NULL) {
 
@@ -402,6 +404,11 @@ FolderView::FolderView(ViewMode _mode, QWidget* parent):
   layout->setMargin(0);
   setLayout(layout);
 
+  thumbnailViewportTimer_ = new QTimer(this);
+  thumbnailViewportTimer_->setSingleShot(true);
+  thumbnailViewportTimer_->setInterval(50);
+  connect(thumbnailViewportTimer_, &QTimer::timeout, this, &FolderView::updateThumbnailViewport);
+
   setViewMode(_mode);
   setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 
@@ -542,6 +549,14 @@ void FolderView::setViewMode(ViewMode _mode) {
     view->setDragDropMode(QAbstractItemView::DragDrop);
     view->setDropIndicatorShown(true);
 
+    // load the thumbnails near the visible part of the view first
+    QScrollBar* scrollBars[] = {view->horizontalScrollBar(), view->verticalScrollBar()};
+    for(int i = 0; i < 2; ++i) {
+      QScrollBar* scrollBar = scrollBars[i];
+      connect(scrollBar, &QScrollBar::valueChanged, this, &FolderView::queueThumbnailViewportUpdate, Qt::UniqueConnection);
+      connect(scrollBar, &QScrollBar::rangeChanged, this, &FolderView::queueThumbnailViewportUpdate, Qt::UniqueConnection);
+    }
+
     if(model_) {
       // FIXME: preserve selections
       model_->setThumbnailSize(iconSize.width());
@@ -622,6 +637,51 @@ void FolderView::setModel(ProxyFolderModel* model) {
   model_ = model;
 }
 
+void FolderView::queueThumbnailViewportUpdate() {
+  // do not restart the timer, otherwise nothing is updated during a long scroll
+  if(!thumbnailViewportTimer_->isActive())
+    thumbnailViewportTimer_->start();
+}
+
+void FolderView::updateThumbnailViewport() {
+  if(!view || !model_ || !model_->showThumbnails())
+    return;
+  int rows = model_->rowCount();
+  if(rows == 0)
+    return;
+  int scrollPos = view->horizontalScrollBar()->value() + view->verticalScrollBar()->value();
+  int direction = scrollPos > lastScrollPos_ ? 1 : (scrollPos < lastScrollPos_ ? -1 : 0);
+  lastScrollPos_ = scrollPos;
+
+  // The items are laid out in row order, left to right and wrapped in icon
+  // mode, top to bottom and wrapped in compact mode, so the visible rows can
+  // be found by bisection.
+  bool horizontal = (mode == CompactMode);
+  QRect visible = view->viewport()->rect();
+  int visibleStart = horizontal ? visible.left() : visible.top();
+  int visibleEnd = horizontal ? visible.right() : visible.bottom();
+  int low = 0, high = rows;
+  while(low < high) { // the first row ending below the top of the viewport
+    int mid = (low + high) / 2;
+    QRect rect = view->visualRect(model_->index(mid, 0));
+    if((horizontal ? rect.right() : rect.bottom()) < visibleStart)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  int firstRow = low;
+  high = rows;
+  while(low < high) { // the first row starting below the bottom of the viewport
+    int mid = (low + high) / 2;
+    QRect rect = view->visualRect(model_->index(mid, 0));
+    if((horizontal ? rect.left() : rect.top()) <= visibleEnd)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  model_->setThumbnailViewport(firstRow, low - 1, direction);
+}
+
 bool FolderView::event(QEvent* event) {
   switch(event->type()) {
     case QEvent::StyleChange:
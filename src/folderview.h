@@ -144,6 +144,8 @@ public Q_SLOTS:
 private Q_SLOTS:
   void onAutoSelectionTimeout();
   void onSelChangedTimeout();
+  void queueThumbnailViewportUpdate();
+  void updateThumbnailViewport();
 
 Q_SIGNALS:
   void clicked(int type, FmFileInfo* file);
@@ -163,6 +165,8 @@ private:
   QTimer* autoSelectionTimer_;
   QModelIndex lastAutoSelectionIndex_;
   QTimer* selChangedTimer_;
+  QTimer* thumbnailViewportTimer_; // limits how often thumbnails are reprioritized while scrolling
+  int lastScrollPos_;
 };
 
 }
@@ -22,6 +22,9 @@
 #include <QLocale>
 #include "icontheme.h"
 #include "thumbnailloader.h"
+#include "thumbnailengine.h"
+#include "thumbnailcache.h"
+#include "volumelabelresolver.h"
 
 namespace Fm {
 
@@ -31,6 +34,9 @@ struct LibFmQtData {
 
   IconTheme* iconTheme;
   ThumbnailLoader* thumbnailLoader;
+  ThumbnailEngine* thumbnailEngine;
+  ThumbnailCache* thumbnailCache;
+  VolumeLabelResolver* volumeLabelResolver;
   QTranslator translator;
   int refCount;
   Q_DISABLE_COPY(LibFmQtData)
@@ -47,11 +53,17 @@ LibFmQtData::LibFmQtData(): refCount(1) {
   // g_setenv("G_MESSAGES_DEBUG", "all", true);
   iconTheme = new IconTheme();
   thumbnailLoader = new ThumbnailLoader();
+  thumbnailEngine = new ThumbnailEngine();
+  thumbnailCache = new ThumbnailCache();
+  volumeLabelResolver = new VolumeLabelResolver();
 }
 
 LibFmQtData::~LibFmQtData() {
   delete iconTheme;
+  delete thumbnailCache;
+  delete thumbnailEngine;
   delete thumbnailLoader;
+  delete volumeLabelResolver;
   fm_finalize();
 }
 
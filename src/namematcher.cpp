@@ -0,0 +1,225 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "namematcher.h"
+#include <QString>
+#include <algorithm>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Fm {
+
+QByteArray foldName(const char* name, int len) {
+  QByteArray folded(name, len);
+  char* p = folded.data();
+  for(int i = 0; i < len; ++i) {
+    unsigned char ch = p[i];
+    if(ch >= 0x80) // not ASCII, let Qt handle the Unicode case folding
+      return QString::fromUtf8(name, len).toCaseFolded().toUtf8();
+    if(ch >= 'A' && ch <= 'Z')
+      p[i] = ch + ('a' - 'A');
+  }
+  return folded;
+}
+
+// find needle starting at s[i] for i in [begin, end), the plain way
+static int findSubstringScalar(const char* s, int begin, int end, const char* needle, int needleLen) {
+  while(begin < end) {
+    const char* p = static_cast<const char*>(memchr(s + begin, needle[0], end - begin));
+    if(!p)
+      break;
+    int i = p - s;
+    if(memcmp(p + 1, needle + 1, needleLen - 1) == 0)
+      return i;
+    begin = i + 1;
+  }
+  return -1;
+}
+
+// The SIMD versions compare a block of candidate positions at once against the
+// first and the last byte of the needle, and only check the positions where
+// both match with memcmp(). See http://0x80.pl/articles/simd-strfind.html
+int findSubstring(const char* s, int len, const char* needle, int needleLen) {
+  if(needleLen == 0)
+    return 0;
+  if(needleLen > len)
+    return -1;
+  // positions where the needle may start
+  int end = len - needleLen + 1;
+  int i = 0;
+  if(needleLen > 1) {
+#if defined(__AVX2__)
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLen - 1]);
+    for(; i + 32 <= end; i += 32) {
+      __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+      __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + needleLen - 1));
+      unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst),
+                                                            _mm256_cmpeq_epi8(last, blockLast)));
+      while(mask) {
+        int bit = __builtin_ctz(mask);
+        if(memcmp(s + i + bit + 1, needle + 1, needleLen - 2) == 0)
+          return i + bit;
+        mask &= mask - 1;
+      }
+    }
+#elif defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLen - 1]);
+    for(; i + 16 <= end; i += 16) {
+      __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+      __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + needleLen - 1));
+      unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                      _mm_cmpeq_epi8(last, blockLast)));
+      while(mask) {
+        int bit = __builtin_ctz(mask);
+        if(memcmp(s + i + bit + 1, needle + 1, needleLen - 2) == 0)
+          return i + bit;
+        mask &= mask - 1;
+      }
+    }
+#endif
+  }
+  return findSubstringScalar(s, i, end, needle, needleLen);
+}
+
+bool matchesSubsequence(const char* name, int len, const char* pattern, int patternLen) {
+  // memchr() is vectorized by the C library, so skipping ahead is cheap
+  int pos = 0;
+  for(int i = 0; i < patternLen; ++i) {
+    if(pos >= len)
+      return false;
+    const char* p = static_cast<const char*>(memchr(name + pos, pattern[i], len - pos));
+    if(!p)
+      return false;
+    pos = p - name + 1;
+  }
+  return true;
+}
+
+NameBuffer::NameBuffer():
+  garbage_(0) {
+}
+
+void NameBuffer::clear() {
+  buffer_.clear();
+  entryOffsets_.clear();
+  entryLengths_.clear();
+  entrySlots_.clear();
+  slotEntries_.clear();
+  garbage_ = 0;
+}
+
+void NameBuffer::insert(int slot, const char* name) {
+  while(slotEntries_.size() <= slot)
+    slotEntries_.append(-1);
+  if(slotEntries_[slot] >= 0)
+    remove(slot);
+  QByteArray folded = foldName(name, strlen(name));
+  slotEntries_[slot] = entrySlots_.size();
+  entryOffsets_.append(buffer_.size());
+  entryLengths_.append(folded.size());
+  entrySlots_.append(slot);
+  buffer_.append(folded);
+  buffer_.append('\0'); // a pattern never matches across two names
+}
+
+void NameBuffer::remove(int slot) {
+  if(slot >= slotEntries_.size() || slotEntries_[slot] < 0)
+    return;
+  int entry = slotEntries_[slot];
+  entrySlots_[entry] = -1;
+  slotEntries_[slot] = -1;
+  garbage_ += entryLengths_[entry] + 1;
+  if(garbage_ > 4096 && garbage_ > buffer_.size() / 2)
+    compact();
+}
+
+void NameBuffer::compact() {
+  QByteArray buffer;
+  buffer.reserve(buffer_.size() - garbage_);
+  QVector<int> offsets, lengths, slots;
+  for(int entry = 0; entry < entrySlots_.size(); ++entry) {
+    int slot = entrySlots_[entry];
+    if(slot < 0)
+      continue;
+    slotEntries_[slot] = slots.size();
+    offsets.append(buffer.size());
+    lengths.append(entryLengths_[entry]);
+    slots.append(slot);
+    buffer.append(buffer_.constData() + entryOffsets_[entry], entryLengths_[entry] + 1);
+  }
+  buffer_ = buffer;
+  entryOffsets_ = offsets;
+  entryLengths_ = lengths;
+  entrySlots_ = slots;
+  garbage_ = 0;
+}
+
+bool NameBuffer::matches(int slot, const QByteArray& pattern, bool subsequence) const {
+  if(slot >= slotEntries_.size() || slotEntries_[slot] < 0)
+    return false;
+  int entry = slotEntries_[slot];
+  const char* name = buffer_.constData() + entryOffsets_[entry];
+  int len = entryLengths_[entry];
+  if(subsequence)
+    return matchesSubsequence(name, len, pattern.constData(), pattern.size());
+  return findSubstring(name, len, pattern.constData(), pattern.size()) >= 0;
+}
+
+void NameBuffer::matchAll(const QByteArray& pattern, bool subsequence, QBitArray* matched, QBitArray* live) const {
+  int numSlots = slotEntries_.size();
+  matched->fill(false, numSlots);
+  live->fill(false, numSlots);
+  for(int slot = 0; slot < numSlots; ++slot) {
+    if(slotEntries_[slot] >= 0)
+      live->setBit(slot);
+  }
+
+  if(subsequence) {
+    for(int entry = 0; entry < entrySlots_.size(); ++entry) {
+      int slot = entrySlots_[entry];
+      if(slot >= 0 && matchesSubsequence(buffer_.constData() + entryOffsets_[entry], entryLengths_[entry],
+                                         pattern.constData(), pattern.size()))
+        matched->setBit(slot);
+    }
+    return;
+  }
+
+  // scan the whole buffer at once, and map each hit back to the name containing it
+  const char* data = buffer_.constData();
+  int size = buffer_.size();
+  int pos = 0;
+  while(pos < size) {
+    int hit = findSubstring(data + pos, size - pos, pattern.constData(), pattern.size());
+    if(hit < 0)
+      break;
+    hit += pos;
+    int entry = std::upper_bound(entryOffsets_.constBegin(), entryOffsets_.constEnd(), hit) - entryOffsets_.constBegin() - 1;
+    int slot = entrySlots_[entry];
+    if(slot >= 0)
+      matched->setBit(slot);
+    pos = entryOffsets_[entry] + entryLengths_[entry] + 1; // continue with the next name
+  }
+}
+
+}
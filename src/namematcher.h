@@ -0,0 +1,75 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_NAMEMATCHER_H
+#define FM_NAMEMATCHER_H
+
+#include "libfmqtglobals.h"
+#include <QByteArray>
+#include <QBitArray>
+#include <QVector>
+
+namespace Fm {
+
+// Case fold a UTF-8 file name or pattern for NameBuffer. ASCII names are
+// folded in place, others go through QString::toCaseFolded().
+LIBFM_QT_API QByteArray foldName(const char* name, int len);
+
+// Offset of the first occurrence of needle in haystack, or -1.
+// Uses SSE2 or AVX2 when the compiler targets them.
+LIBFM_QT_API int findSubstring(const char* haystack, int len, const char* needle, int needleLen);
+
+// true if all characters of pattern appear in name in the same order
+LIBFM_QT_API bool matchesSubsequence(const char* name, int len, const char* pattern, int patternLen);
+
+// The case folded names of the items of a FolderModel, stored one after
+// another in a single buffer so matching a pattern against all of them is
+// one linear scan. Names are addressed by the slot of their item in
+// FolderModelItemStore. Removed names are left in place until they take up
+// half of the buffer, then the buffer is compacted.
+class LIBFM_QT_API NameBuffer {
+public:
+  NameBuffer();
+
+  void clear();
+  void insert(int slot, const char* name);
+  void remove(int slot);
+
+  // test the name of one slot against a folded pattern
+  bool matches(int slot, const QByteArray& pattern, bool subsequence) const;
+
+  // Test all names against a folded pattern. Sets the bits of the matching
+  // slots in matched, and of all slots holding a name in live.
+  void matchAll(const QByteArray& pattern, bool subsequence, QBitArray* matched, QBitArray* live) const;
+
+private:
+  void compact();
+
+private:
+  QByteArray buffer_; // folded names, each terminated by '\0'
+  // the names in the order they are stored in buffer_
+  QVector<int> entryOffsets_;
+  QVector<int> entryLengths_;
+  QVector<int> entrySlots_; // -1 for removed names
+  QVector<int> slotEntries_; // entry of each slot, -1 for free slots
+  int garbage_; // bytes taken by removed names
+};
+
+}
+
+#endif // FM_NAMEMATCHER_H
@@ -26,6 +26,7 @@
 #include <QTimer>
 #include "utilities.h"
 #include "placesmodelitem.h"
+#include "volumelabelresolver.h"
 
 using namespace Fm;
 
@@ -145,6 +146,10 @@ PlacesModel::PlacesModel(QObject* parent):
 
   // update some icons when the icon theme is changed
   connect(IconTheme::instance(), &IconTheme::changed, this, &PlacesModel::updateIcons);
+
+  // show volume labels of the mounts once they are looked up
+  connect(VolumeLabelResolver::instance(), &VolumeLabelResolver::labelResolved, this, &PlacesModel::updateMountItems);
+  connect(VolumeLabelResolver::instance(), &VolumeLabelResolver::labelsInvalidated, this, &PlacesModel::updateMountItems);
 }
 
 void PlacesModel::loadBookmarks() {
@@ -412,6 +417,15 @@ void PlacesModel::updateIcons() {
   }
 }
 
+void PlacesModel::updateMountItems() {
+  int n = devicesRoot->rowCount();
+  for(int row = 0; row < n; ++row) {
+    PlacesModelItem* item = static_cast<PlacesModelItem*>(devicesRoot->child(row));
+    if(item->type() == PlacesModelItem::Mount)
+      static_cast<PlacesModelMountItem*>(item)->update();
+  }
+}
+
 Qt::ItemFlags PlacesModel::flags(const QModelIndex& index) const {
   if(index.column() == 1) // make 2nd column of every row selectable.
     return Qt::ItemIsSelectable | Qt::ItemIsEnabled;
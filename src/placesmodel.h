@@ -77,6 +77,7 @@ public:
 public Q_SLOTS:
   void updateIcons();
   void updateTrash();
+  void updateMountItems();
 
 protected:
 
@@ -22,7 +22,7 @@
 #include "icontheme.h"
 #include <gio/gio.h>
 #include <QDebug>
-#include <QProcess>
+#include "volumelabelresolver.h"
 
 namespace Fm {
 
@@ -180,38 +180,17 @@ void PlacesModelMountItem::update() {
   // set title
   QString mount_name = QString::fromUtf8(g_mount_get_name(mount_));
   setText(mount_name);
-  qDebug() << "probono: Get the 'Volume label' for the volume";
-  QString displayName;
-#ifdef __FreeBSD__
-  qDebug() << "probono: Using 'fstyp -l /dev/" + mount_name + "' on FreeBSD";
-  // NOTE: foldermodelitem.cpp has similar code for what gets shown in computer:///
-  // NOTE: Alternatively, we could just use mountpoints that have the volume label as their name
-  QProcess p;
-  QString program = "fstyp";
-  QStringList arguments;
-  arguments << "-l" << "/dev/" + mount_name;
-  p.start(program, arguments);
-  p.waitForFinished();
-  QString result(p.readAllStandardOutput());
-  result.replace("\n", "");
-  result = result.trimmed();
-  qDebug() << "probono: result:" << result;
-  if (result.split(" ").length() == 1) {
-      if (result.split(" ")[0] != "" && result.split(" ")[0] != nullptr) {
-          // We got a filesystem but no volume label back, so use the filesystem
-          displayName = result.split(" ")[0];
-          setText(displayName);
-      }
-  } else if (result.split(" ").length() == 2) {
-      if (result.split(" ")[1] != "" && result.split(" ")[1] != nullptr) {
-          // We got a filesystem and a volume label back, so use the volume label
-          displayName = result.split(" ")[1];
-          setText(displayName);
-      }
+  // show the volume label once it is known, PlacesModel calls update() again when it arrives.
+  // NOTE: foldermodelitem.cpp does the same for what gets shown in computer:///
+  VolumeLabelResolver* resolver = VolumeLabelResolver::instance();
+  QString label;
+  if(resolver) {
+    QString device = VolumeLabelResolver::deviceForMount(mount_);
+    if(device.isEmpty())
+      device = QStringLiteral("/dev/") + mount_name;
+    if(resolver->label(device, &label) && !label.isEmpty())
+      setText(label);
   }
-#else
-  qDebug() << "probono: TODO: To be implemented for this OS";
-#endif
 
   // set path
   GFile* mount_root = g_mount_get_root(mount_);
@@ -0,0 +1,69 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "pnginfo.h"
+#include <string.h>
+
+namespace Fm {
+
+static const char pngSignature[8] = {'\211', 'P', 'N', 'G', '\r', '\n', '\032', '\n'};
+
+// integers in PNG files are big-endian
+static quint32 readUInt32(const char* p) {
+  const uchar* u = reinterpret_cast<const uchar*>(p);
+  return (quint32(u[0]) << 24) | (quint32(u[1]) << 16) | (quint32(u[2]) << 8) | u[3];
+}
+
+bool readPngInfo(const char* data, int size, PngInfo* info) {
+  if(size < 8 || memcmp(data, pngSignature, 8) != 0)
+    return false;
+  int pos = 8;
+  // each chunk is its length, type, data and a CRC, which is not checked
+  while(size - pos >= 12) {
+    quint32 length = readUInt32(data + pos);
+    const char* type = data + pos + 4;
+    const char* chunk = data + pos + 8;
+    if(length > quint32(size - pos - 12))
+      return false;
+    if(pos == 8) {
+      // the header always comes first
+      if(memcmp(type, "IHDR", 4) != 0 || length < 8)
+        return false;
+      info->width = int(readUInt32(chunk));
+      info->height = int(readUInt32(chunk + 4));
+      if(info->width <= 0 || info->height <= 0)
+        return false;
+    }
+    else if(memcmp(type, "IDAT", 4) == 0)
+      return true;
+    else if(memcmp(type, "IEND", 4) == 0)
+      return false;
+    else if(memcmp(type, "tEXt", 4) == 0) {
+      // the keyword and the text are separated by a null byte
+      const char* separator = static_cast<const char*>(memchr(chunk, 0, length));
+      if(separator) {
+        int keyLength = int(separator - chunk);
+        info->text.insert(QByteArray(chunk, keyLength), QByteArray(separator + 1, int(length) - keyLength - 1));
+      }
+    }
+    pos += 12 + int(length);
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_PNGINFO_H
+#define FM_PNGINFO_H
+
+#include "libfmqtglobals.h"
+#include <QByteArray>
+#include <QHash>
+
+namespace Fm {
+
+// What the chunks in front of the image data of a PNG file tell about it.
+struct LIBFM_QT_API PngInfo {
+  PngInfo():
+    width(0),
+    height(0) {
+  }
+
+  int width;
+  int height;
+  // the uncompressed text chunks (tEXt) by keyword. Compressed ones (zTXt,
+  // iTXt) and the ones behind the image data are not read.
+  QHash<QByteArray, QByteArray> text;
+};
+
+// Read the size and the text of a PNG file by walking its chunk list up to
+// the first image data chunk, which is not inflated. The freedesktop.org
+// thumbnails can be checked this way without decoding them. Returns false
+// if data is not a PNG file or ends before the image data.
+LIBFM_QT_API bool readPngInfo(const char* data, int size, PngInfo* info);
+
+}
+
+#endif // FM_PNGINFO_H
@@ -20,27 +20,38 @@
 
 #include "proxyfoldermodel.h"
 #include "foldermodel.h"
+#include "namematcher.h"
 #include <QCollator>
 #include <QDebug>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
 
 using namespace Fm;
 
 ProxyFolderModel::ProxyFolderModel(QObject * parent):
   QSortFilterProxyModel(parent),
-  thumbnailSize_(0),
   showHidden_(false),
-  showThumbnails_(false),
   folderFirst_(true),
-  userName_(),
-  desktopMode_(false){
+  showThumbnails_(false),
+  thumbnailSize_(0),
+  userId_(getuid()), // files not owned by the user are devices, we sort them separately
+  nameFilterMode_(NameFilterSubstring),
+  desktopMode_(false),
+  sortSuspended_(false),
+  parallelSortThreshold_(20000) {
   setDynamicSortFilter(true);
+  collator_.setNumericMode(true);
+  collator_.setCaseSensitivity(Qt::CaseInsensitive);
+  collatorCase_.setNumericMode(true);
+  collatorCase_.setCaseSensitivity(Qt::CaseSensitive);
   setSortCaseSensitivity(Qt::CaseInsensitive);
-
-  // get the user name so we can sort devices separately
-  userName_ = qgetenv("USER");
-  if (userName_.isEmpty())
-    userName_ = qgetenv("USERNAME");
-  qDebug() << "username: " << userName_;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0) // this signal requires Qt >= 5.11
+  connect(this, &QSortFilterProxyModel::sortCaseSensitivityChanged, this, &ProxyFolderModel::sortFilterChanged);
+#endif
 }
 
 ProxyFolderModel::~ProxyFolderModel() {
@@ -74,7 +85,55 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
       }
     }
   }
+  FolderModel* oldSrcModel = static_cast<FolderModel*>(sourceModel());
+  if(oldSrcModel) {
+    disconnect(oldSrcModel, &FolderModel::loadingStarted, this, &ProxyFolderModel::onSourceLoadingStarted);
+    disconnect(oldSrcModel, &FolderModel::loadingFinished, this, &ProxyFolderModel::onSourceLoadingFinished);
+    disconnect(oldSrcModel, &FolderModel::rowsAboutToBeRemoved, this, &ProxyFolderModel::onSourceRowsAboutToBeRemoved);
+    disconnect(oldSrcModel, &FolderModel::modelAboutToBeReset, this, &ProxyFolderModel::clearNameFilterResults);
+  }
+  clearNameFilterResults();
+  if(sortSuspended_) {
+    sortSuspended_ = false;
+    setDynamicSortFilter(true);
+  }
   QSortFilterProxyModel::setSourceModel(model);
+  if(model) {
+    FolderModel* newSrcModel = static_cast<FolderModel*>(model);
+    connect(newSrcModel, &FolderModel::loadingStarted, this, &ProxyFolderModel::onSourceLoadingStarted);
+    connect(newSrcModel, &FolderModel::loadingFinished, this, &ProxyFolderModel::onSourceLoadingFinished);
+    connect(newSrcModel, &FolderModel::rowsAboutToBeRemoved, this, &ProxyFolderModel::onSourceRowsAboutToBeRemoved);
+    // items are moved to other slots during a reset
+    connect(newSrcModel, &FolderModel::modelAboutToBeReset, this, &ProxyFolderModel::clearNameFilterResults);
+    if(newSrcModel->isLoading())
+      suspendSorting();
+  }
+}
+
+// Re-sorting every batch of files inserted while a folder loads costs far more
+// than sorting everything once, so dynamic sorting is turned off until the end.
+void ProxyFolderModel::suspendSorting() {
+  if(!sortSuspended_ && dynamicSortFilter()) {
+    sortSuspended_ = true;
+    setDynamicSortFilter(false);
+  }
+}
+
+void ProxyFolderModel::onSourceLoadingStarted() {
+  suspendSorting();
+}
+
+void ProxyFolderModel::onSourceLoadingFinished() {
+  FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+  if(!sortSuspended_ || !srcModel || srcModel->isLoading())
+    return;
+  sortSuspended_ = false;
+  if(srcModel->rowCount() >= parallelSortThreshold_)
+    computeSortRanks();
+  // turning dynamic sorting on sorts the rows, with a single layout change.
+  // lessThan() only compares the precomputed ranks if there are any.
+  setDynamicSortFilter(true);
+  sortRanks_.clear();
 }
 
 void ProxyFolderModel::sort(int column, Qt::SortOrder order) {
@@ -104,85 +163,292 @@ void ProxyFolderModel::setFolderFirst(bool folderFirst) {
 }
 
 bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex & source_parent) const {
-  if(!showHidden_) {
-    QAbstractItemModel* srcModel = sourceModel();
-    QString name = srcModel->data(srcModel->index(source_row, 0, source_parent)).toString();
-    if(name.startsWith(".") || name.endsWith("~"))
-      return false;
-  }
+  FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+  FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(source_row, 0, source_parent));
+  if(!item)
+    return true;
+  // the hidden flag is cached in the item, no need to build its display name
+  if(!showHidden_ && item->isHidden())
+    return false;
+  if(!nameFilter_.isEmpty() && !matchesNameFilter(item))
+    return false;
   // apply additional filters if there're any
   Q_FOREACH(ProxyFolderModelFilter* filter, filters_) {
-    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
-    FmFileInfo* fileInfo = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-    if(!filter->filterAcceptsRow(this, fileInfo))
+    if(!filter->filterAcceptsRow(this, item->info))
       return false;
   }
   return true;
 }
 
+// Test the file name against the quick filter. The result is remembered per
+// item slot, so when the pattern only gets longer, the items already rejected
+// do not need to be tested again.
+bool ProxyFolderModel::matchesNameFilter(FolderModelItem* item) const {
+  int slot = item->slot;
+  if(slot >= nameTested_.size()) {
+    int size = qMax(slot + 1, nameTested_.size() * 2);
+    nameTested_.resize(size);
+    nameRejected_.resize(size);
+  }
+  if(!nameTested_.testBit(slot)) {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    bool subsequence = nameFilterMode_ == NameFilterSubsequence;
+    nameRejected_.setBit(slot, !srcModel->nameMatches(item, foldedNameFilter_, subsequence));
+    nameTested_.setBit(slot);
+  }
+  return !nameRejected_.testBit(slot);
+}
+
+void ProxyFolderModel::setNameFilter(const QString& pattern, NameFilterMode mode) {
+  if(pattern == nameFilter_ && mode == nameFilterMode_)
+    return;
+  QByteArray utf8 = pattern.toUtf8();
+  QByteArray folded = foldName(utf8.constData(), utf8.size());
+  bool subsequence = mode == NameFilterSubsequence;
+  // if the new pattern contains the old one, every name it matches was
+  // matched before, so only the names accepted so far need to be tested
+  const QByteArray& old = foldedNameFilter_;
+  bool narrowing = !old.isEmpty() && mode == nameFilterMode_
+                   && (subsequence ? matchesSubsequence(folded.constData(), folded.size(), old.constData(), old.size())
+                       : findSubstring(folded.constData(), folded.size(), old.constData(), old.size()) >= 0);
+  nameFilter_ = pattern;
+  foldedNameFilter_ = folded;
+  nameFilterMode_ = mode;
+
+  FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+  if(narrowing)
+    nameTested_ = nameRejected_;
+  else if(!folded.isEmpty() && srcModel) {
+    // match all names in one pass over the name buffer of the source model
+    QBitArray matched, live;
+    srcModel->matchNames(folded, subsequence, &matched, &live);
+    nameRejected_ = live & ~matched;
+    nameTested_ = live;
+  }
+  else
+    clearNameFilterResults();
+  invalidateFilter();
+  Q_EMIT sortFilterChanged();
+}
+
+void ProxyFolderModel::clearNameFilterResults() {
+  nameTested_.fill(false);
+  nameRejected_.fill(false);
+}
+
+// the slots of removed items are reused by new items, forget their results
+void ProxyFolderModel::onSourceRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last) {
+  FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+  for(int row = first; row <= last; ++row) {
+    FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(row, 0, parent));
+    if(item && item->slot < nameTested_.size()) {
+      nameTested_.clearBit(item->slot);
+      nameRejected_.clearBit(item->slot);
+    }
+  }
+}
+
+namespace {
+
+// settings of ProxyFolderModel used by itemLessThan(), copied so that
+// worker threads do not need to touch the model
+struct SortParams {
+  int column;
+  Qt::SortOrder order;
+  const QCollator* collator;
+  bool folderFirst;
+  bool desktopMode;
+  qint32 userId;
+};
+
+// Compare two items for ProxyFolderModel::lessThan(). Only reads the keys
+// cached in the items, comparisons must not allocate.
+// The keys need to be computed before this is called from another thread.
+static bool itemLessThan(FolderModelItem* leftItem, FolderModelItem* rightItem, const SortParams& params) {
+  const FolderModelItem::SortKeys& leftKeys = leftItem->sortKeys();
+  const FolderModelItem::SortKeys& rightKeys = rightItem->sortKeys();
+
+  if (params.desktopMode) {
+    // where the owner is different, always sort by owner first to keep devices before files
+    if (leftKeys.uid != rightKeys.uid) {
+      if (params.order == Qt::AscendingOrder)
+        return leftKeys.uid < rightKeys.uid;
+      else
+        return leftKeys.uid > rightKeys.uid;
+    }
+    else if (leftKeys.uid != params.userId) {
+      // these are devices, sort them by modification date always
+      return leftKeys.mtime < rightKeys.mtime;
+    }
+  }
+
+  if(params.folderFirst) {
+    if(leftKeys.isDir != rightKeys.isDir)
+      return params.order == Qt::AscendingOrder ? leftKeys.isDir : rightKeys.isDir;
+  }
+
+  switch(params.column) {
+    case FolderModel::ColumnFileName:
+      // natural order ("file2" before "file10"), the sort keys are cached in the items
+      return leftItem->nameSortKey(*params.collator).compare(rightItem->nameSortKey(*params.collator)) < 0;
+    case FolderModel::ColumnFileMTime:
+      return leftKeys.mtime < rightKeys.mtime;
+    case FolderModel::ColumnFileSize:
+      return leftKeys.size < rightKeys.size;
+    case FolderModel::ColumnFileOwner:
+      return leftKeys.uid < rightKeys.uid;
+    case FolderModel::ColumnFileType:
+      return FolderModelItem::mimeTypeRank(leftKeys.mimeId) < FolderModelItem::mimeTypeRank(rightKeys.mimeId);
+  }
+  return false;
+}
+
+struct ItemLessThan {
+  ItemLessThan(const SortParams& params): params_(params) {
+  }
+  bool operator()(FolderModelItem* left, FolderModelItem* right) const {
+    return itemLessThan(left, right, params_);
+  }
+  const SortParams& params_;
+};
+
+// computes the name keys of a range of items and sorts it
+class SortRangeJob: public QRunnable {
+public:
+  SortRangeJob(FolderModelItem** begin, FolderModelItem** end, const SortParams& params):
+    begin_(begin), end_(end), params_(params) {
+  }
+
+  void run() {
+    // the lazily computed keys are per item, so each thread only fills in its own items.
+    // QCollator is not thread safe, every thread makes its own.
+    QCollator collator(params_.collator->locale());
+    collator.setNumericMode(params_.collator->numericMode());
+    collator.setCaseSensitivity(params_.collator->caseSensitivity());
+    SortParams params = params_;
+    params.collator = &collator;
+    if(params.column == FolderModel::ColumnFileName) {
+      for(FolderModelItem** it = begin_; it != end_; ++it)
+        (*it)->nameSortKey(collator);
+    }
+    std::stable_sort(begin_, end_, ItemLessThan(params));
+  }
+
+private:
+  FolderModelItem** begin_;
+  FolderModelItem** end_;
+  const SortParams& params_;
+};
+
+// merges two adjacent sorted ranges [begin, middle) and [middle, end) into out
+class MergeRangesJob: public QRunnable {
+public:
+  MergeRangesJob(FolderModelItem** begin, FolderModelItem** middle, FolderModelItem** end, FolderModelItem** out, const SortParams& params):
+    begin_(begin), middle_(middle), end_(end), out_(out), params_(params) {
+  }
+
+  void run() {
+    std::merge(begin_, middle_, middle_, end_, out_, ItemLessThan(params_));
+  }
+
+private:
+  FolderModelItem** begin_;
+  FolderModelItem** middle_;
+  FolderModelItem** end_;
+  FolderModelItem** out_;
+  const SortParams& params_;
+};
+
+}
+
+// Sort all rows of the source model with a parallel merge sort and store the
+// position of each source row in sortRanks_. The UI thread waits for the
+// workers, so the items are not touched by anything else meanwhile.
+void ProxyFolderModel::computeSortRanks() {
+  FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+  SortParams params;
+  params.column = sortColumn();
+  params.order = sortOrder();
+  params.collator = &sortCollator();
+  params.folderFirst = folderFirst_;
+  params.desktopMode = desktopMode_;
+  params.userId = userId_;
+
+  int n = srcModel->rowCount();
+  QVector<FolderModelItem*> items(n);
+  for(int row = 0; row < n; ++row) {
+    FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(row, 0));
+    item->sortKeys(); // not thread safe, uses the shared mime type table
+    items[row] = item;
+  }
+  FolderModelItem::updateMimeTypeRanks();
+
+  QThreadPool pool;
+  int numRanges = qMax(1, QThread::idealThreadCount());
+  QVector<int> bounds; // the sorted ranges are [bounds[i], bounds[i + 1])
+  for(int i = 0; i <= numRanges; ++i)
+    bounds.append(int(qint64(n) * i / numRanges));
+  FolderModelItem** data = items.data();
+  for(int i = 0; i < numRanges; ++i)
+    pool.start(new SortRangeJob(data + bounds[i], data + bounds[i + 1], params));
+  pool.waitForDone();
+
+  // merge pairs of adjacent ranges until only one is left
+  QVector<FolderModelItem*> buffer(n);
+  FolderModelItem** out = buffer.data();
+  while(bounds.size() > 2) {
+    QVector<int> merged;
+    int i = 0;
+    for(; i + 2 < bounds.size(); i += 2) {
+      pool.start(new MergeRangesJob(data + bounds[i], data + bounds[i + 1], data + bounds[i + 2], out + bounds[i], params));
+      merged.append(bounds[i]);
+    }
+    if(i + 1 < bounds.size()) { // odd number of ranges, the last one is copied as is
+      std::copy(data + bounds[i], data + bounds[i + 1], out + bounds[i]);
+      merged.append(bounds[i]);
+    }
+    merged.append(n);
+    pool.waitForDone();
+    std::swap(data, out);
+    bounds = merged;
+  }
+
+  // items comparing equal get the same rank, so comparing ranks gives
+  // exactly the same answers as comparing the items
+  sortRanks_.fill(0, n);
+  int rank = 0;
+  for(int i = 0; i < n; ++i) {
+    if(i > 0 && itemLessThan(data[i - 1], data[i], params))
+      ++rank;
+    sortRanks_[data[i]->row] = rank;
+  }
+}
+
 bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& right) const {
   FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
   // left and right are indexes of source model, not the proxy model.
   if(srcModel) {
-    FmFileInfo* leftInfo = srcModel->fileInfoFromIndex(left);
-    FmFileInfo* rightInfo = srcModel->fileInfoFromIndex(right);
-
-    if (desktopMode_) {
-      // where the owner is different, always sort by owner first to keep devices before files
-      if (QString(fm_file_info_get_disp_owner(leftInfo)) != QString(fm_file_info_get_disp_owner(rightInfo))) {
-        if (sortOrder() == Qt::AscendingOrder)
-          return QString(fm_file_info_get_disp_owner(leftInfo)) < QString(fm_file_info_get_disp_owner(rightInfo));
-        else
-          return QString(fm_file_info_get_disp_owner(leftInfo)) > QString(fm_file_info_get_disp_owner(rightInfo));
-      }
-      else if (QString(fm_file_info_get_disp_owner(leftInfo)) != userName_) {
-        // these are devices, sort them by modification date always
-        return fm_file_info_get_mtime(leftInfo) < fm_file_info_get_mtime(rightInfo);
-      }
-    }
+    // right after loading, the rows were already sorted by computeSortRanks()
+    if(!sortRanks_.isEmpty())
+      return sortRanks_[left.row()] < sortRanks_[right.row()];
+
+    FolderModelItem* leftItem = srcModel->itemFromIndex(left);
+    FolderModelItem* rightItem = srcModel->itemFromIndex(right);
 
-    if(Q_UNLIKELY(!leftInfo || !rightInfo)) {
+    if(Q_UNLIKELY(!leftItem || !rightItem)) {
       // In theory, this should not happen, but it's safer to add the null check.
       // This is reported in https://github.com/lxde/filer-qt/issues/205
       return false;
     }
 
-    if(folderFirst_) {
-      bool leftIsFolder = (bool)fm_file_info_is_dir(leftInfo);
-      bool rightIsFolder = (bool)fm_file_info_is_dir(rightInfo);
-      if(leftIsFolder != rightIsFolder)
-        return sortOrder() == Qt::AscendingOrder ? leftIsFolder : rightIsFolder;
-    }
-
-    switch(sortColumn()) {
-      case FolderModel::ColumnFileName:
-        if(sortCaseSensitivity() == Qt::CaseSensitive) {
-          // fm_file_info_get_collate_key_nocasefold() uses g_utf8_casefold() from glib internally, which
-          // is only an approximation not working correctly in some locales.
-          // FIXME: we may use QCollator (since Qt 5.2) for this, but the performance impact is unknown
-          return strcmp(fm_file_info_get_collate_key_nocasefold(leftInfo), fm_file_info_get_collate_key_nocasefold(rightInfo)) < 0;
-          /*
-          QCollator coll;
-          coll.setCaseSensitivity(Qt::CaseSensitive);
-          coll.setIgnorePunctuation(false);
-          coll.setNumericMode(true);
-          return coll.compare(QString::fromUtf8(fm_file_info_get_disp_name(leftInfo)), QString::fromUtf8(fm_file_info_get_disp_name(rightInfo))) < 0;
-          */
-        }
-        else {
-          // linguistic case insensitive ordering
-          return strcmp(fm_file_info_get_collate_key(leftInfo), fm_file_info_get_collate_key(rightInfo)) < 0;
-        }
-      case FolderModel::ColumnFileMTime:
-        return fm_file_info_get_mtime(leftInfo) < fm_file_info_get_mtime(rightInfo);
-      case FolderModel::ColumnFileSize:
-        return fm_file_info_get_size(leftInfo) < fm_file_info_get_size(rightInfo);
-      case FolderModel::ColumnFileOwner:
-        // TODO: sort by owner
-        break;
-      case FolderModel::ColumnFileType:
-        break;
-    }
+    SortParams params;
+    params.column = sortColumn();
+    params.order = sortOrder();
+    params.collator = &sortCollator();
+    params.folderFirst = folderFirst_;
+    params.desktopMode = desktopMode_;
+    params.userId = userId_;
+    return itemLessThan(leftItem, rightItem, params);
   }
   return QSortFilterProxyModel::lessThan(left, right);
 }
@@ -222,6 +488,9 @@ void ProxyFolderModel::setThumbnailSize(int size) {
   if(size != thumbnailSize_) {
     FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     if(showThumbnails_ && srcModel) {
+      // ask for cache of thumbnails of the new size in source model first,
+      // so the old ones are kept to derive the new size from when it is smaller
+      srcModel->cacheThumbnails(size);
       // free cached thumbnails of the old size
       if(thumbnailSize_ != 0)
         srcModel->releaseThumbnails(thumbnailSize_);
@@ -229,8 +498,6 @@ void ProxyFolderModel::setThumbnailSize(int size) {
         // if the old thumbnail size is 0, we did not turn on thumbnail initially
         connect(srcModel, &FolderModel::thumbnailLoaded, this, &ProxyFolderModel::onThumbnailLoaded);
       }
-      // ask for cache of thumbnails of the new size in source model
-      srcModel->cacheThumbnails(size);
       // reload all items, FIXME: can we only update items previously having thumbnails
       Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, 0));
     }
@@ -239,15 +506,54 @@ void ProxyFolderModel::setThumbnailSize(int size) {
   }
 }
 
+void ProxyFolderModel::setThumbnailViewport(int firstRow, int lastRow, int scrollDirection) {
+  FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+  if(!srcModel || !showThumbnails_ || thumbnailSize_ == 0 || lastRow < firstRow)
+    return;
+  int visibleRows = lastRow - firstRow + 1;
+  int lookAhead = visibleRows / 2 + 1;
+  int cancelDistance = visibleRows * 4 + lookAhead;
+
+  srcModel->prioritizeThumbnails([=](int srcRow) {
+    int row = mapFromSource(srcModel->index(srcRow, 0)).row();
+    if(row < 0) // filtered out
+      return -1;
+    int distance = 0;
+    int direction = 0;
+    if(row < firstRow) {
+      distance = firstRow - row;
+      direction = -1;
+    }
+    else if(row > lastRow) {
+      distance = row - lastRow;
+      direction = 1;
+    }
+    if(distance > cancelDistance)
+      return -1;
+    // rows we are scrolling away from can wait longer
+    return direction == scrollDirection ? distance : distance * 2;
+  });
+
+  // prefetch the thumbnails of the rows about to be scrolled into view
+  if(scrollDirection != 0) {
+    for(int distance = 1; distance <= lookAhead; ++distance) {
+      int row = scrollDirection > 0 ? lastRow + distance : firstRow - distance;
+      if(row < 0 || row >= rowCount())
+        break;
+      srcModel->thumbnailFromIndex(mapToSource(index(row, 0)), thumbnailSize_, distance);
+    }
+  }
+}
+
 QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
   if(index.column() == 0) { // only show the decoration role for the first column
     if(role == Qt::DecorationRole && showThumbnails_ && thumbnailSize_) {
       // we need to show thumbnails instead of icons
       FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
       QModelIndex srcIndex = mapToSource(index);
-      QImage image = srcModel->thumbnailFromIndex(srcIndex, thumbnailSize_);
-      if(!image.isNull()) // if we got a thumbnail of the desired size, use it
-        return QVariant(image);
+      QPixmap pixmap = srcModel->thumbnailFromIndex(srcIndex, thumbnailSize_);
+      if(!pixmap.isNull()) // if we got a thumbnail of the desired size, use it
+        return QVariant(pixmap);
     }
   }
   // fallback to icons if thumbnails are not available
@@ -259,7 +565,7 @@ void ProxyFolderModel::onThumbnailLoaded(const QModelIndex& srcIndex, int size)
   // FolderModelItem* item = srcModel->itemFromIndex(srcIndex);
   // qDebug("ProxyFolderModel::onThumbnailLoaded: %d, %s", size, item->displayName.toUtf8().data());
 
-  if(size == thumbnailSize_) { // if a thumbnail of the size we want is loaded
+  if(size >= thumbnailSize_) { // if a thumbnail of the size we want, or one it is scaled from, is loaded
     QModelIndex index = mapFromSource(srcIndex);
     Q_EMIT dataChanged(index, index);
   }
@@ -278,6 +584,7 @@ void ProxyFolderModel::removeFilter(ProxyFolderModelFilter* filter) {
 }
 
 void ProxyFolderModel::updateFilters() {
+  clearNameFilterResults();
   invalidate();
   Q_EMIT sortFilterChanged();
 }
@@ -25,6 +25,9 @@
 #include <QSortFilterProxyModel>
 #include <libfm/fm.h>
 #include <QList>
+#include <QCollator>
+#include <QBitArray>
+#include <QVector>
 
 namespace Fm {
 
@@ -59,11 +62,6 @@ public:
     return folderFirst_;
   }
 
-  void setSortCaseSensitivity(Qt::CaseSensitivity cs) {
-    QSortFilterProxyModel::setSortCaseSensitivity(cs);
-    Q_EMIT sortFilterChanged();
-  }
-
   bool showThumbnails() {
     return showThumbnails_;
   }
@@ -74,6 +72,12 @@ public:
   }
   void setThumbnailSize(int size);
 
+  // Called by the view with the rows currently visible. Queued thumbnails are
+  // loaded in order of their distance from these rows, a few rows ahead in the
+  // scroll direction (-1, 0 or 1) are prefetched and loads of rows scrolled far
+  // away are cancelled.
+  void setThumbnailViewport(int firstRow, int lastRow, int scrollDirection);
+
   FmFileInfo* fileInfoFromIndex(const QModelIndex& index) const;
 
   virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
@@ -83,13 +87,41 @@ public:
   void removeFilter(ProxyFolderModelFilter* filter);
   void updateFilters();
 
+  enum NameFilterMode {
+    NameFilterSubstring, // the name contains the pattern
+    NameFilterSubsequence // the characters of the pattern appear in the name in order
+  };
+
+  // only show the files whose name matches pattern, ignoring case
+  void setNameFilter(const QString& pattern, NameFilterMode mode = NameFilterSubstring);
+  const QString& nameFilter() const {
+    return nameFilter_;
+  }
+
+  NameFilterMode nameFilterMode() const {
+    return nameFilterMode_;
+  }
+
   void setDesktopMode();
 
+  // folders with at least this many files are sorted on all cores after loading
+  int parallelSortThreshold() const {
+    return parallelSortThreshold_;
+  }
+
+  void setParallelSortThreshold(int rows) {
+    parallelSortThreshold_ = rows;
+  }
+
 Q_SIGNALS:
   void sortFilterChanged();
 
 protected Q_SLOTS:
   void onThumbnailLoaded(const QModelIndex& srcIndex, int size);
+  void onSourceLoadingStarted();
+  void onSourceLoadingFinished();
+  void onSourceRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+  void clearNameFilterResults();
 
 protected:
   bool filterAcceptsRow(int source_row, const QModelIndex & source_parent) const;
@@ -97,6 +129,13 @@ protected:
   // void reloadAllThumbnails();
 
 private:
+  void suspendSorting();
+  void computeSortRanks();
+  // the items cache their sort keys for both modes, nothing to recompute on a switch
+  const QCollator& sortCollator() const {
+    return sortCaseSensitivity() == Qt::CaseSensitive ? collatorCase_ : collator_;
+  }
+  bool matchesNameFilter(FolderModelItem* item) const;
 
 private:
   bool showHidden_;
@@ -104,8 +143,19 @@ private:
   bool showThumbnails_;
   int thumbnailSize_;
   QList<ProxyFolderModelFilter*> filters_;
-  QString userName_;
+  qint32 userId_;
+  QCollator collator_; // makes the case insensitive sort keys of the names
+  QCollator collatorCase_; // makes the case sensitive ones
+  QString nameFilter_;
+  QByteArray foldedNameFilter_; // nameFilter_ folded with foldName()
+  NameFilterMode nameFilterMode_;
+  // per item slot: whether the name was tested against nameFilter_, and the result
+  mutable QBitArray nameTested_;
+  mutable QBitArray nameRejected_;
   bool desktopMode_;
+  bool sortSuspended_; // dynamic sorting is off while the source model loads
+  int parallelSortThreshold_;
+  QVector<int> sortRanks_; // position of each source row, only set during the sort after loading
 };
 
 }
@@ -203,6 +203,7 @@ bool Settings::loadFile(QString filePath) {
   showThumbnails_ = settings.value("ShowThumbnails", true).toBool();
   setMaxThumbnailFileSize(settings.value("MaxThumbnailFileSize", 4096).toInt());
   setThumbnailLocalFilesOnly(settings.value("ThumbnailLocalFilesOnly", true).toBool());
+  setThumbnailCacheSize(settings.value("ThumbnailCacheSize", 128).toInt());
   settings.endGroup();
 
   settings.beginGroup("FolderView");
@@ -294,6 +295,7 @@ bool Settings::saveFile(QString filePath) {
   settings.setValue("ShowThumbnails", showThumbnails_);
   settings.setValue("MaxThumbnailFileSize", maxThumbnailFileSize());
   settings.setValue("ThumbnailLocalFilesOnly", thumbnailLocalFilesOnly());
+  settings.setValue("ThumbnailCacheSize", thumbnailCacheSize());
   settings.endGroup();
 
   settings.beginGroup("FolderView");
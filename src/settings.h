@@ -28,6 +28,7 @@
 #include "desktopwindow.h"
 #include "sidepane.h"
 #include "thumbnailloader.h"
+#include "thumbnailcache.h"
 
 namespace Filer {
 
@@ -468,6 +469,15 @@ public:
     Fm::ThumbnailLoader::setMaxThumbnailFileSize(size);
   }
 
+  // memory used by the thumbnails of all folders, in MiB
+  int thumbnailCacheSize() {
+    return int(Fm::ThumbnailCache::maxBytes() / (1024 * 1024));
+  }
+
+  void setThumbnailCacheSize(int size) {
+    Fm::ThumbnailCache::setMaxBytes(qint64(qMax(size, 1)) * 1024 * 1024);
+  }
+
   void setThumbnailIconSize(int thumbnailIconSize) {
     thumbnailIconSize_ = thumbnailIconSize;
   }
@@ -33,6 +33,7 @@
 #include "cachedfoldermodel.h"
 #include <QTimer>
 #include <QTextStream>
+#include <string.h>
 
 using namespace Fm;
 
@@ -41,16 +42,16 @@ namespace Filer {
 bool ProxyFilter::filterAcceptsRow(const Fm::ProxyFolderModel* model, FmFileInfo* info) const {
   if(!model || !info)
     return true;
-  QString baseName(fm_file_info_get_name(info));
-  if(!virtHiddenList_.isEmpty() && !model->showHidden() && virtHiddenList_.contains(baseName))
+  if(!virtHiddenList_.isEmpty() && !model->showHidden()) {
+    const char* baseName = fm_file_info_get_name(info);
+    if(virtHiddenList_.contains(QByteArray::fromRawData(baseName, strlen(baseName))))
       return false;
-  if(!filterStr_.isEmpty() && !baseName.contains(filterStr_, Qt::CaseInsensitive))
-    return false;
+  }
   return true;
 }
 
 void ProxyFilter::setVirtHidden(FmFolder* folder) {
-  virtHiddenList_ = QStringList(); // reset the list
+  virtHiddenList_.clear(); // reset the list
   if(!folder) return;
   if(FmPath* path = fm_folder_get_path(folder)) {
     char* pathStr = fm_path_to_str(path);
@@ -61,7 +62,7 @@ void ProxyFilter::setVirtHidden(FmFolder* folder) {
       if(file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         QTextStream in(&file);
         while(!in.atEnd())
-          virtHiddenList_.append(in.readLine());
+          virtHiddenList_.insert(in.readLine().toUtf8());
         file.close();
       }
     }
@@ -95,6 +96,11 @@ TabPage::TabPage(FmPath* path, QWidget* parent):
   proxyFilter_ = new ProxyFilter();
   proxyModel_->addFilter(proxyFilter_);
 
+  statusTimer_ = new QTimer(this);
+  statusTimer_->setSingleShot(true);
+  statusTimer_->setInterval(1000);
+  connect(statusTimer_, &QTimer::timeout, this, &TabPage::updateStatusText);
+
   // FIXME: this is very dirty
   folderView_->setModel(proxyModel_);
   verticalLayout->addWidget(folderView_);
@@ -312,9 +318,28 @@ QString TabPage::formatStatusText() {
 }
 
 /*static */ void TabPage::onFolderContentChanged(FmFolder* _folder, TabPage* pThis) {
-  /* update status text */
-  pThis->statusText_[StatusTextNormal] = pThis->formatStatusText();
-  Q_EMIT pThis->statusChanged(StatusTextNormal, pThis->statusText_[StatusTextNormal]);
+  // a folder changing all the time only updates its status text once per second
+  if(pThis->folderModel_ && pThis->folderModel_->isHot()) {
+    if(!pThis->statusTimer_->isActive())
+      pThis->statusTimer_->start();
+    return;
+  }
+  pThis->updateStatusText();
+}
+
+void TabPage::updateStatusText() {
+  statusText_[StatusTextNormal] = formatStatusText();
+  Q_EMIT statusChanged(StatusTextNormal, statusText_[StatusTextNormal]);
+}
+
+// large folders are inserted into the model in several steps, show how far we got
+void TabPage::onInsertionProgress(int inserted, int total) {
+  QString& text = statusText_[StatusTextNormal];
+  if(inserted < total)
+    text = tr("Loading... (%1 of %2 items)").arg(inserted).arg(total);
+  else
+    text = formatStatusText();
+  Q_EMIT statusChanged(StatusTextNormal, text);
 }
 
 QString TabPage::pathName() {
@@ -343,6 +368,7 @@ void TabPage::chdir(FmPath* newPath, bool addHistory) {
 
     // free the previous model
     if(folderModel_) {
+      disconnect(folderModel_, &FolderModel::insertionProgress, this, &TabPage::onInsertionProgress);
       proxyModel_->setSourceModel(NULL);
       folderModel_->unref(); // unref the cached model
       folderModel_ = NULL;
@@ -372,6 +398,7 @@ void TabPage::chdir(FmPath* newPath, bool addHistory) {
   g_signal_connect(folder_, "content-changed", G_CALLBACK(onFolderContentChanged), this);
 
   folderModel_ = CachedFolderModel::modelFromFolder(folder_);
+  connect(folderModel_, &FolderModel::insertionProgress, this, &TabPage::onInsertionProgress);
   proxyModel_->setSourceModel(folderModel_);
   proxyModel_->sort(proxyModel_->sortColumn(), proxyModel_->sortOrder());
   Settings& settings = static_cast<Application*>(qApp)->settings();
@@ -521,7 +548,7 @@ void TabPage::setShowHidden(bool showHidden) {
 
 void TabPage:: applyFilter() {
   if(!proxyModel_) return;
-  proxyModel_->updateFilters();
+  // setFilterStr() already refiltered the rows
   statusText_[StatusTextNormal] = formatStatusText();
   Q_EMIT statusChanged(StatusTextNormal, statusText_[StatusTextNormal]);
 }
@@ -23,11 +23,15 @@
 
 #include <QWidget>
 #include <QVBoxLayout>
+#include <QSet>
+#include <QByteArray>
 #include <libfm/fm.h>
 #include "browsehistory.h"
 #include "view.h"
 #include "path.h"
 
+class QTimer;
+
 namespace Fm {
   class FileLauncher;
   class FolderModel;
@@ -45,16 +49,9 @@ public:
   bool filterAcceptsRow(const Fm::ProxyFolderModel* model, FmFileInfo* info) const;
   virtual ~ProxyFilter() {}
   void setVirtHidden(FmFolder* folder);
-  QString getFilterStr() {
-    return filterStr_;
-  }
-  void setFilterStr(QString str) {
-    filterStr_ = str;
-  }
 
 private:
-  QString filterStr_;
-  QStringList virtHiddenList_;
+  QSet<QByteArray> virtHiddenList_; // UTF-8 file names listed in .hidden
 };
 
 class TabPage : public QWidget {
@@ -109,6 +106,9 @@ public:
   }
   void setSortCaseSensitive(bool value) {
     proxyModel_->setSortCaseSensitivity(value ? Qt::CaseSensitive : Qt::CaseInsensitive);
+#if QT_VERSION < QT_VERSION_CHECK(5, 11, 0) // the proxy model cannot tell before Qt 5.11
+    Q_EMIT sortFilterChanged();
+#endif
   }
 
   bool showHidden() {
@@ -195,14 +195,15 @@ public:
   }
 
   QString getFilterStr() {
-    if(proxyFilter_)
-      return proxyFilter_->getFilterStr();
+    if(proxyModel_)
+      return proxyModel_->nameFilter();
     return QString();
   }
 
+  // the proxy model filters the names itself, narrowing the previous result if it can
   void setFilterStr(QString str) {
-    if(proxyFilter_)
-      proxyFilter_->setFilterStr(str);
+    if(proxyModel_)
+      proxyModel_->setNameFilter(str);
   }
 
   void applyFilter();
@@ -220,6 +221,8 @@ protected Q_SLOTS:
   void onModelSortFilterChanged();
   void onSelChanged(int numSel);
   void restoreScrollPos();
+  void onInsertionProgress(int inserted, int total);
+  void updateStatusText();
 
 private:
   void freeFolder();
@@ -242,6 +245,7 @@ private:
   FmFolder* folder_;
   QString title_;
   QString statusText_[StatusTextNum];
+  QTimer* statusTimer_; // rate-limits status updates of hot folders
   Fm::BrowseHistory history_; // browsing history
   bool overrideCursor_;
 };
@@ -0,0 +1,167 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#include "thumbnailcache.h"
+
+namespace Fm {
+
+ThumbnailCache* ThumbnailCache::theThumbnailCache = NULL;
+qint64 ThumbnailCache::maxBytes_ = 128 * 1024 * 1024;
+
+uint qHash(const ThumbnailCache::Key& key, uint seed) {
+  return ::qHash(key.path, seed) ^ ::qHash(key.mtime, seed) ^ uint(key.size * 0x9e3779b1u);
+}
+
+ThumbnailCache::ThumbnailCache():
+  first_(NULL),
+  last_(NULL),
+  nextHandle_(1),
+  bytes_(0),
+  hits_(0),
+  misses_(0) {
+  if(theThumbnailCache == NULL)
+    theThumbnailCache = this;
+}
+
+ThumbnailCache::~ThumbnailCache() {
+  clear();
+  if(theThumbnailCache == this)
+    theThumbnailCache = NULL;
+}
+
+//static
+ThumbnailCache::Key ThumbnailCache::makeKey(FmFileInfo* fileInfo, qint64 mtime, int size) {
+  Key key;
+  char* path = fm_path_to_str(fm_file_info_get_path(fileInfo));
+  key.path = QByteArray(path);
+  g_free(path);
+  key.mtime = mtime;
+  key.size = size;
+  return key;
+}
+
+ThumbnailCache::Handle ThumbnailCache::find(FmFileInfo* fileInfo, int size) {
+  QHash<Key, Entry*>::const_iterator it = entries_.constFind(makeKey(fileInfo, fm_file_info_get_mtime(fileInfo), size));
+  if(it == entries_.constEnd()) {
+    ++misses_;
+    return 0;
+  }
+  ++hits_;
+  touch(it.value());
+  return it.value()->handle;
+}
+
+ThumbnailCache::Handle ThumbnailCache::insert(FmFileInfo* fileInfo, qint64 mtime, int size, const QPixmap& pixmap) {
+  return insert(makeKey(fileInfo, mtime, size), pixmap);
+}
+
+ThumbnailCache::Handle ThumbnailCache::insertScaled(Handle source, int size, const QPixmap& pixmap) {
+  QHash<Handle, Entry*>::const_iterator it = handles_.constFind(source);
+  if(it == handles_.constEnd())
+    return 0;
+  Key key = it.value()->key;
+  key.size = size;
+  return insert(key, pixmap);
+}
+
+ThumbnailCache::Handle ThumbnailCache::insert(const Key& key, const QPixmap& pixmap) {
+  QHash<Key, Entry*>::iterator it = entries_.find(key);
+  if(it != entries_.end())
+    remove(it.value());
+
+  Entry* entry = new Entry;
+  entry->key = key;
+  entry->handle = nextHandle_++;
+  entry->pixmap = pixmap;
+  entry->bytes = qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+  entry->prev = NULL;
+  entry->next = first_;
+  if(first_)
+    first_->prev = entry;
+  else
+    last_ = entry;
+  first_ = entry;
+  entries_.insert(key, entry);
+  handles_.insert(entry->handle, entry);
+  bytes_ += entry->bytes;
+  // never evict what was just inserted, even if it alone is over the budget
+  evict(entry);
+  return entry->handle;
+}
+
+QPixmap ThumbnailCache::pixmap(Handle handle) {
+  QHash<Handle, Entry*>::const_iterator it = handles_.constFind(handle);
+  if(it == handles_.constEnd()) {
+    if(handle != 0)
+      ++misses_;
+    return QPixmap();
+  }
+  touch(it.value());
+  return it.value()->pixmap;
+}
+
+void ThumbnailCache::clear() {
+  while(last_)
+    remove(last_);
+}
+
+//static
+void ThumbnailCache::setMaxBytes(qint64 bytes) {
+  maxBytes_ = bytes;
+  if(theThumbnailCache)
+    theThumbnailCache->evict();
+}
+
+// move the entry to the front of the list
+void ThumbnailCache::touch(Entry* entry) {
+  if(entry == first_)
+    return;
+  unlink(entry);
+  entry->prev = NULL;
+  entry->next = first_;
+  first_->prev = entry;
+  first_ = entry;
+}
+
+void ThumbnailCache::unlink(Entry* entry) {
+  if(entry->prev)
+    entry->prev->next = entry->next;
+  else
+    first_ = entry->next;
+  if(entry->next)
+    entry->next->prev = entry->prev;
+  else
+    last_ = entry->prev;
+}
+
+void ThumbnailCache::remove(Entry* entry) {
+  unlink(entry);
+  entries_.remove(entry->key);
+  handles_.remove(entry->handle);
+  bytes_ -= entry->bytes;
+  delete entry;
+}
+
+// drop the least recently used entries until the budget is met
+void ThumbnailCache::evict(Entry* keep) {
+  while(bytes_ > maxBytes_ && last_ && last_ != keep)
+    remove(last_);
+}
+
+}
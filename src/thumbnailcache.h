@@ -0,0 +1,138 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef FM_THUMBNAILCACHE_H
+#define FM_THUMBNAILCACHE_H
+
+#include "libfmqtglobals.h"
+#include <libfm/fm.h>
+#include <QByteArray>
+#include <QHash>
+#include <QPixmap>
+
+namespace Fm {
+
+// Thumbnails loaded by all folder models of the process, so going back to a
+// folder does not decode its thumbnails again. Entries are keyed by the path
+// and mtime of the file and the size in pixels, and the least recently used
+// ones are dropped when more than maxBytes() are held.
+// The folder models only keep handles to the entries. A handle stays valid
+// until its entry is evicted, pixmap() returns a null pixmap after that.
+// QPixmap is not thread safe, so the cache is only used by the GUI thread.
+class LIBFM_QT_API ThumbnailCache {
+public:
+  typedef quint64 Handle; // 0 is never a valid handle
+
+  ThumbnailCache();
+  ~ThumbnailCache();
+
+  static ThumbnailCache* instance() {
+    return theThumbnailCache;
+  }
+
+  // the handle of the thumbnail of the file with size pixels, or 0 if not cached
+  Handle find(FmFileInfo* fileInfo, int size);
+  // Replaces a thumbnail already cached for the same file and size. The
+  // thumbnail was made of the file as it was at mtime, which may be older
+  // than the mtime of fileInfo if the file changed while it was made.
+  Handle insert(FmFileInfo* fileInfo, qint64 mtime, int size, const QPixmap& pixmap);
+  // cache a thumbnail scaled down from the one of source for the same version
+  // of the file, returns 0 if source was evicted meanwhile
+  Handle insertScaled(Handle source, int size, const QPixmap& pixmap);
+  // marks the entry as recently used
+  QPixmap pixmap(Handle handle);
+  void clear();
+
+  // the memory budget, applied to the existing entries right away
+  static qint64 maxBytes() {
+    return maxBytes_;
+  }
+
+  static void setMaxBytes(qint64 bytes);
+
+  qint64 bytes() const {
+    return bytes_;
+  }
+
+  int count() const {
+    return handles_.size();
+  }
+
+  // lookups with find(), and pixmap() calls for evicted entries, which are misses
+  quint64 hits() const {
+    return hits_;
+  }
+
+  quint64 misses() const {
+    return misses_;
+  }
+
+  double hitRate() const {
+    quint64 lookups = hits_ + misses_;
+    return lookups ? double(hits_) / lookups : 0.0;
+  }
+
+private:
+  struct Key {
+    QByteArray path;
+    qint64 mtime;
+    int size;
+
+    bool operator==(const Key& other) const {
+      return size == other.size && mtime == other.mtime && path == other.path;
+    }
+  };
+
+  // an entry in both hash tables and in the list ordered by last use
+  struct Entry {
+    Key key;
+    Handle handle;
+    QPixmap pixmap;
+    qint64 bytes;
+    Entry* prev; // used more recently
+    Entry* next; // used less recently
+  };
+
+  friend uint qHash(const Key& key, uint seed);
+
+  static Key makeKey(FmFileInfo* fileInfo, qint64 mtime, int size);
+  Handle insert(const Key& key, const QPixmap& pixmap);
+  void touch(Entry* entry);
+  void unlink(Entry* entry);
+  void remove(Entry* entry);
+  void evict(Entry* keep = NULL);
+
+  Q_DISABLE_COPY(ThumbnailCache)
+
+private:
+  static ThumbnailCache* theThumbnailCache;
+  static qint64 maxBytes_;
+  QHash<Key, Entry*> entries_;
+  QHash<Handle, Entry*> handles_;
+  Entry* first_; // most recently used
+  Entry* last_; // least recently used, evicted first
+  Handle nextHandle_;
+  qint64 bytes_;
+  quint64 hits_;
+  quint64 misses_;
+};
+
+}
+
+#endif // FM_THUMBNAILCACHE_H
@@ -0,0 +1,548 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "thumbnailengine.h"
+#include "thumbnailloader.h"
+#include "filebuffer.h"
+#include "pnginfo.h"
+#include "exifpreview.h"
+#include "thumbnailscaler.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThread>
+#include <glib.h>
+#include <algorithm>
+
+namespace Fm {
+
+enum {
+  NormalThumbnailSize = 128, // ~/.cache/thumbnails/normal
+  LargeThumbnailSize = 256 // ~/.cache/thumbnails/large
+};
+
+struct ThumbnailRequest {
+  ThumbnailRequest(FmFileInfo* fileInfo, int size, ThumbnailCallback callback, gpointer userData, int priority):
+    info(fm_file_info_ref(fileInfo)),
+    size(size),
+    callback(callback),
+    userData(userData),
+    priority(priority),
+    fallback(NULL),
+    // ThumbnailEngine::mtime() is asked for the fallback requests as well
+    mtime(QByteArray::number(qint64(fm_file_info_get_mtime(fileInfo)))),
+    cacheSize(0),
+    canGenerate(true),
+    mayHavePreview(false),
+    previewOnly(false),
+    readingSource(false),
+    cacheChecked(false) {
+  }
+
+  ~ThumbnailRequest() {
+    fm_file_info_unref(info);
+  }
+
+  FmFileInfo* info;
+  int size;
+  ThumbnailCallback callback;
+  gpointer userData;
+  int priority;
+  QAtomicInt cancelled;
+  FmThumbnailLoader* fallback; // set while libfm loads the thumbnail
+
+  // copied from info so the worker threads never touch it
+  QByteArray sourcePath;
+  QByteArray uri;
+  QByteArray mtime;
+  QByteArray cachePath; // empty if thumbnails of this size are not cached
+  int cacheSize; // size of the thumbnails stored in cachePath
+  bool canGenerate; // false if the file is too large to generate a thumbnail
+  bool mayHavePreview; // a photo which may have an embedded preview, even if it is too large
+  bool previewOnly; // camera RAW files Qt cannot decode, libfm gets them if there is no preview
+
+  bool readingSource; // false while the cached thumbnail is being tried
+  bool cacheChecked; // the cached thumbnail is known to be up to date
+  // the file read by ThumbnailReadJob, in a buffer from the pool
+  QByteArray data;
+  QImage image; // the result
+
+  // Files are read rather than mapped, see readWholeFile().
+  bool readFile(const QByteArray& path) {
+    return readWholeFile(path.constData(), &data);
+  }
+
+  QByteArray bytes() const {
+    return data;
+  }
+
+  void releaseData() {
+    if(!data.isNull())
+      returnFileBuffer(data);
+  }
+};
+
+// reads the cached thumbnail or the source file and queues it for decoding
+class ThumbnailReadJob: public QRunnable {
+public:
+  ThumbnailReadJob(ThumbnailEngine* engine, ThumbnailRequest* request):
+    engine_(engine),
+    request_(request) {
+  }
+
+  void run();
+
+private:
+  bool isCacheOutdated();
+
+private:
+  ThumbnailEngine* engine_;
+  ThumbnailRequest* request_;
+};
+
+// decodes and scales the data read by ThumbnailReadJob
+class ThumbnailDecodeJob: public QRunnable {
+public:
+  ThumbnailDecodeJob(ThumbnailEngine* engine, ThumbnailRequest* request):
+    engine_(engine),
+    request_(request) {
+  }
+
+  void run();
+
+private:
+  bool decodeCachedThumbnail();
+  void generateThumbnail();
+
+private:
+  ThumbnailEngine* engine_;
+  ThumbnailRequest* request_;
+};
+
+// decodes a cached thumbnail libfm handed over without decoding it
+class FallbackDecodeJob: public QRunnable {
+public:
+  FallbackDecodeJob(ThumbnailEngine* engine, ThumbnailRequest* request):
+    engine_(engine),
+    request_(request) {
+  }
+
+  void run();
+
+private:
+  ThumbnailEngine* engine_;
+  ThumbnailRequest* request_;
+};
+
+}
+
+using namespace Fm;
+
+// decode an image which is shown no larger than size x size
+static QImage decodeImage(const QByteArray& data, int size, int* orientation = NULL) {
+  QBuffer buffer;
+  buffer.setData(data);
+  buffer.open(QIODevice::ReadOnly);
+  QImageReader reader(&buffer);
+  return ThumbnailLoader::readScaledImage(reader, size, orientation);
+}
+
+// decode the preview embedded in a photo if it is large enough for size
+static QImage decodePreview(const QByteArray& data, int size, int* orientation) {
+  EmbeddedPreview preview;
+  if(!findEmbeddedPreview(data.constData(), data.size(), size, &preview))
+    return QImage();
+  *orientation = preview.orientation;
+  return decodeImage(QByteArray::fromRawData(data.constData() + preview.offset, preview.length), size);
+}
+
+static bool hasHigherPriority(const ThumbnailRequest* a, const ThumbnailRequest* b) {
+  return a->priority < b->priority;
+}
+
+void ThumbnailReadJob::run() {
+  ThumbnailRequest* request = request_;
+  if(!engine_->isCancelled(request)) {
+    if(!request->readingSource) {
+      // the header is checked before the thumbnail is queued for decoding
+      if(request->readFile(request->cachePath) && !isCacheOutdated()) {
+        engine_->decodePool_.start(new ThumbnailDecodeJob(engine_, request));
+        return;
+      }
+      // not cached yet, or outdated
+      request->releaseData();
+      request->readingSource = true;
+    }
+    if((request->canGenerate || request->mayHavePreview) && request->readFile(request->sourcePath)) {
+      engine_->decodePool_.start(new ThumbnailDecodeJob(engine_, request));
+      return;
+    }
+  }
+  engine_->jobFinished(request);
+}
+
+// Compare the Thumb::MTime and Thumb::URI of the cached thumbnail with the
+// file without decoding it. If they are not found in front of the image data,
+// the decoder checks the decoded image instead.
+bool ThumbnailReadJob::isCacheOutdated() {
+  ThumbnailRequest* request = request_;
+  QByteArray data = request->bytes();
+  PngInfo info;
+  if(!readPngInfo(data.constData(), data.size(), &info))
+    return true;
+  QHash<QByteArray, QByteArray>::const_iterator it = info.text.constFind("Thumb::MTime");
+  if(it == info.text.constEnd())
+    return false;
+  if(it.value() != request->mtime)
+    return true;
+  // Qt compresses long texts, so the URI is usually not there to compare
+  it = info.text.constFind("Thumb::URI");
+  if(it != info.text.constEnd() && it.value() != request->uri)
+    return true;
+  request->cacheChecked = true;
+  return false;
+}
+
+void ThumbnailDecodeJob::run() {
+  ThumbnailRequest* request = request_;
+  if(!engine_->isCancelled(request)) {
+    if(request->readingSource)
+      generateThumbnail();
+    else if(!decodeCachedThumbnail()) {
+      // the cached thumbnail is outdated, go back to the readers for the source file
+      request->readingSource = true;
+      request->releaseData();
+      engine_->readPool_.start(new ThumbnailReadJob(engine_, request), 1);
+      return;
+    }
+  }
+  request->releaseData();
+  engine_->jobFinished(request);
+}
+
+void FallbackDecodeJob::run() {
+  ThumbnailRequest* request = request_;
+  if(!engine_->isCancelled(request))
+    request->image = QImage::fromData(request->data, "PNG");
+  request->releaseData();
+  engine_->jobFinished(request);
+}
+
+bool ThumbnailDecodeJob::decodeCachedThumbnail() {
+  ThumbnailRequest* request = request_;
+  QImage image = decodeImage(request->bytes(), request->size);
+  if(image.isNull())
+    return false;
+  if(!request->cacheChecked && image.text(QStringLiteral("Thumb::MTime")).toLatin1() != request->mtime)
+    return false;
+  request->image = scaleThumbnail(image, request->size);
+  return true;
+}
+
+void ThumbnailDecodeJob::generateThumbnail() {
+  ThumbnailRequest* request = request_;
+  // the cached thumbnail is made from the same decoded image
+  int decodeSize = qMax(request->size, request->cacheSize);
+  int orientation = 1;
+  QImage image;
+  if(request->mayHavePreview)
+    image = decodePreview(request->bytes(), decodeSize, &orientation);
+  if(image.isNull() && request->canGenerate)
+    image = decodeImage(request->bytes(), decodeSize, &orientation);
+  request->releaseData(); // free the file before the scaled copies are made
+  if(image.isNull())
+    return;
+  if(!request->cachePath.isEmpty() && (image.width() > request->cacheSize || image.height() > request->cacheSize)) {
+    // store the thumbnail in the freedesktop.org cache like libfm does, upright
+    QImage thumbnail = scaleThumbnail(image, request->cacheSize, orientation);
+    orientation = 1;
+    thumbnail.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(request->uri));
+    thumbnail.setText(QStringLiteral("Thumb::MTime"), QString::fromLatin1(request->mtime));
+    QString cachePath = QFile::decodeName(request->cachePath);
+    QDir().mkpath(cachePath.left(cachePath.lastIndexOf('/')));
+    QSaveFile file(cachePath);
+    // the permissions are set on the temporary file, so the thumbnail is
+    // never readable by others under its final name, not even briefly
+    if(file.open(QIODevice::WriteOnly) && file.setPermissions(QFile::ReadOwner | QFile::WriteOwner)
+       && thumbnail.save(&file, "PNG"))
+      file.commit();
+    else
+      file.cancelWriting();
+    image = thumbnail;
+  }
+  request->image = scaleThumbnail(image, request->size, orientation);
+}
+
+ThumbnailEngine* ThumbnailEngine::theThumbnailEngine = NULL;
+
+ThumbnailEngine::ThumbnailEngine():
+  inFlight_(0) {
+  // NOTE: only one instance is allowed
+  Q_ASSERT(theThumbnailEngine == NULL);
+  theThumbnailEngine = this;
+
+  // decoding is CPU bound, reading is I/O bound and needs only a few threads
+  // to keep the disk busy and the decoders fed
+  int cpus = QThread::idealThreadCount();
+  if(cpus < 1)
+    cpus = 1;
+  decodePool_.setMaxThreadCount(cpus);
+  readPool_.setMaxThreadCount(qBound(2, cpus / 2, 4));
+  maxInFlight_ = cpus * 3 + readPool_.maxThreadCount();
+
+  Q_FOREACH(const QByteArray& mimeType, QImageReader::supportedMimeTypes()) {
+    mimeTypes_.insert(mimeType);
+  }
+  // TIFF based camera RAW files, findEmbeddedPreview() can read their previews
+  static const char* const rawMimeTypes[] = {
+    "image/x-adobe-dng",
+    "image/x-canon-cr2",
+    "image/x-nikon-nef",
+    "image/x-nikon-nrw",
+    "image/x-pentax-pef",
+    "image/x-samsung-srw",
+    "image/x-sony-arw",
+    "image/x-sony-sr2"
+  };
+  for(unsigned int i = 0; i < sizeof(rawMimeTypes) / sizeof(rawMimeTypes[0]); ++i)
+    rawMimeTypes_.insert(QByteArray(rawMimeTypes[i]));
+  cacheDir_ = QByteArray(g_get_user_cache_dir()) + "/thumbnails/";
+
+  // hand out the results in batches rather than one repaint per thumbnail
+  deliveryTimer_ = new QTimer(this);
+  deliveryTimer_->setSingleShot(true);
+  deliveryTimer_->setInterval(30);
+  connect(deliveryTimer_, &QTimer::timeout, this, &ThumbnailEngine::deliverResults);
+}
+
+ThumbnailEngine::~ThumbnailEngine() {
+  // let the running jobs bail out, a decoder may still queue a read job
+  shuttingDown_.store(1);
+  readPool_.waitForDone();
+  decodePool_.waitForDone();
+  readPool_.waitForDone();
+
+  Q_FOREACH(ThumbnailRequest* request, fallbacks_) {
+    ThumbnailLoader::cancel(request->fallback);
+    delete request;
+  }
+  qDeleteAll(pending_);
+  qDeleteAll(finished_);
+  qDeleteAll(ready_);
+  theThumbnailEngine = NULL;
+}
+
+FmFileInfo* ThumbnailEngine::fileInfo(ThumbnailRequest* request) {
+  return request->info;
+}
+
+int ThumbnailEngine::size(ThumbnailRequest* request) {
+  return request->size;
+}
+
+qint64 ThumbnailEngine::mtime(ThumbnailRequest* request) {
+  return request->mtime.toLongLong();
+}
+
+QImage ThumbnailEngine::image(ThumbnailRequest* request) {
+  return request->image;
+}
+
+bool ThumbnailEngine::canDecode(FmFileInfo* fileInfo) const {
+  if(!fm_path_is_native(fm_file_info_get_path(fileInfo)) || fm_file_info_is_dir(fileInfo))
+    return false;
+  FmMimeType* mimeType = fm_file_info_get_mime_type(fileInfo);
+  if(!mimeType)
+    return false;
+  QByteArray type(fm_mime_type_get_type(mimeType));
+  return mimeTypes_.contains(type) || rawMimeTypes_.contains(type);
+}
+
+ThumbnailRequest* ThumbnailEngine::load(FmFileInfo* fileInfo, int size, ThumbnailCallback callback, gpointer user_data, int priority) {
+  ThumbnailRequest* request = new ThumbnailRequest(fileInfo, size, callback, user_data, priority);
+  if(!canDecode(fileInfo)) {
+    // let libfm and the external thumbnailers handle it
+    request->fallback = ThumbnailLoader::load(fileInfo, size, onFallbackLoaded, request);
+    fallbacks_.insert(request);
+    return request;
+  }
+
+  FmPath* path = fm_file_info_get_path(fileInfo);
+  char* str = fm_path_to_str(path);
+  request->sourcePath = str;
+  g_free(str);
+  str = fm_path_to_uri(path);
+  request->uri = str;
+  g_free(str);
+
+  // maxThumbnailFileSize() is in KiB, cached thumbnails are used regardless
+  int maxFileSize = ThumbnailLoader::maxThumbnailFileSize();
+  if(maxFileSize > 0 && fm_file_info_get_size(fileInfo) > (goffset(maxFileSize) << 10))
+    request->canGenerate = false;
+
+  // Camera photos are tried with their EXIF thumbnail or RAW preview first,
+  // regardless of their size, since only a small part of the file is read.
+  QByteArray mimeType(fm_mime_type_get_type(fm_file_info_get_mime_type(fileInfo)));
+  if(mimeType == "image/jpeg")
+    request->mayHavePreview = true;
+  else if(rawMimeTypes_.contains(mimeType)) {
+    request->mayHavePreview = true;
+    // some systems have an image format plugin for them
+    if(!mimeTypes_.contains(mimeType)) {
+      request->canGenerate = false;
+      request->previewOnly = true;
+    }
+  }
+
+  // larger sizes are not cached and always generated from the source file,
+  // and the thumbnails themselves are not thumbnailed again
+  if(size <= LargeThumbnailSize && !request->sourcePath.startsWith(cacheDir_)) {
+    request->cacheSize = size <= NormalThumbnailSize ? NormalThumbnailSize : LargeThumbnailSize;
+    QByteArray md5 = QCryptographicHash::hash(request->uri, QCryptographicHash::Md5).toHex();
+    request->cachePath = cacheDir_ + (request->cacheSize == NormalThumbnailSize ? "normal/" : "large/") + md5 + ".png";
+  }
+  else
+    request->readingSource = true;
+
+  // behind the queued requests of the same priority
+  pending_.insert(std::upper_bound(pending_.begin(), pending_.end(), request, hasHigherPriority), request);
+  dispatch();
+  return request;
+}
+
+void ThumbnailEngine::cancel(ThumbnailRequest* request) {
+  request->cancelled.store(1);
+  if(pending_.removeOne(request))
+    delete request;
+  else if(request->fallback) {
+    ThumbnailLoader::cancel(request->fallback);
+    fallbacks_.remove(request);
+    delete request;
+  }
+  // otherwise it is owned by a worker or waiting for delivery and freed there
+}
+
+//static
+void ThumbnailEngine::setPriority(ThumbnailRequest* request, int priority) {
+  request->priority = priority;
+}
+
+void ThumbnailEngine::updatePriorities() {
+  std::stable_sort(pending_.begin(), pending_.end(), hasHigherPriority);
+}
+
+bool ThumbnailEngine::isCancelled(ThumbnailRequest* request) const {
+  return request->cancelled.load() || shuttingDown_.load();
+}
+
+// feed the readers while keeping the number of files held in memory bounded
+void ThumbnailEngine::dispatch() {
+  while(inFlight_ < maxInFlight_ && !pending_.isEmpty()) {
+    ++inFlight_;
+    readPool_.start(new ThumbnailReadJob(this, pending_.takeFirst()));
+  }
+}
+
+void ThumbnailEngine::jobFinished(ThumbnailRequest* request) {
+  finishedLock_.lock();
+  bool wasEmpty = finished_.isEmpty();
+  finished_.append(request);
+  finishedLock_.unlock();
+  // one queued call collects everything finished until it runs
+  if(wasEmpty)
+    QMetaObject::invokeMethod(this, "collectFinished", Qt::QueuedConnection);
+}
+
+void ThumbnailEngine::collectFinished() {
+  finishedLock_.lock();
+  QVector<ThumbnailRequest*> finished;
+  finished.swap(finished_);
+  finishedLock_.unlock();
+
+  inFlight_ -= finished.size();
+  Q_FOREACH(ThumbnailRequest* request, finished) {
+    // RAW files without a usable preview may still have an external thumbnailer
+    if(request->previewOnly && request->image.isNull() && !isCancelled(request)) {
+      request->fallback = ThumbnailLoader::load(request->info, request->size, onFallbackLoaded, request);
+      fallbacks_.insert(request);
+    }
+    else
+      ready_.append(request);
+  }
+  dispatch();
+  if(!deliveryTimer_->isActive())
+    deliveryTimer_->start();
+}
+
+void ThumbnailEngine::deliverResults() {
+  // the callbacks may request or cancel thumbnails, so work on a copy
+  QVector<ThumbnailRequest*> ready;
+  ready.swap(ready_);
+
+  // group the requests by receiver, there are usually only a few
+  QVector<QVector<ThumbnailRequest*> > batches;
+  Q_FOREACH(ThumbnailRequest* request, ready) {
+    int i;
+    for(i = 0; i < batches.size(); ++i) {
+      ThumbnailRequest* first = batches[i].first();
+      if(first->callback == request->callback && first->userData == request->userData)
+        break;
+    }
+    if(i == batches.size())
+      batches.append(QVector<ThumbnailRequest*>());
+    batches[i].append(request);
+  }
+
+  Q_FOREACH(const QVector<ThumbnailRequest*>& batch, batches) {
+    QVector<ThumbnailRequest*> requests;
+    requests.reserve(batch.size());
+    // an earlier callback may have cancelled some of them
+    Q_FOREACH(ThumbnailRequest* request, batch) {
+      if(!request->cancelled.load())
+        requests.append(request);
+    }
+    if(!requests.isEmpty())
+      requests.first()->callback(requests, requests.first()->userData);
+  }
+  qDeleteAll(ready);
+}
+
+//static
+void ThumbnailEngine::onFallbackLoaded(FmThumbnailLoader* res, gpointer user_data) {
+  ThumbnailRequest* request = reinterpret_cast<ThumbnailRequest*>(user_data);
+  ThumbnailEngine* pThis = theThumbnailEngine;
+  request->fallback = NULL;
+  pThis->fallbacks_.remove(request);
+  request->data = ThumbnailLoader::encodedImage(res);
+  if(!request->data.isNull()) {
+    // A cached thumbnail libfm found up to date, decode it with the others
+    // rather than in the GUI thread. It is not passed back to libfm again.
+    request->previewOnly = false;
+    ++pThis->inFlight_;
+    pThis->decodePool_.start(new FallbackDecodeJob(pThis, request));
+    return;
+  }
+  request->image = ThumbnailLoader::image(res);
+  pThis->ready_.append(request);
+  if(!pThis->deliveryTimer_->isActive())
+    pThis->deliveryTimer_->start();
+}
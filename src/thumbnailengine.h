@@ -0,0 +1,118 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_THUMBNAILENGINE_H
+#define FM_THUMBNAILENGINE_H
+
+#include "libfmqtglobals.h"
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <libfm/fm.h>
+
+namespace Fm {
+
+struct ThumbnailRequest;
+
+// called with all the requests of one receiver finished since the last call
+typedef void (*ThumbnailCallback)(const QVector<ThumbnailRequest*>& requests, gpointer user_data);
+
+// Generates thumbnails of local image files on all CPU cores.
+// Reading the files is done by a small pool of reader threads which stay a
+// few files ahead of a decoder pool sized to the number of CPUs, so disk and
+// decoding overlap. The freedesktop.org thumbnail cache is used the same way
+// libfm does. Camera photos are made from the preview embedded in them when
+// it is large enough, which spares reading and decoding the whole photo.
+// Finished requests are handed back to the receivers in batches.
+// Files Qt cannot decode, such as videos or remote files, are passed on to the
+// libfm thumbnail loader, which can use external thumbnailers.
+class LIBFM_QT_API ThumbnailEngine: public QObject {
+  Q_OBJECT
+public:
+  ThumbnailEngine();
+  ~ThumbnailEngine();
+
+  static ThumbnailEngine* instance() {
+    return theThumbnailEngine;
+  }
+
+  // The request is owned by the engine. It stays valid until the callback
+  // for it returns or it is cancelled. Queued requests are started in order of
+  // priority, lower values first.
+  ThumbnailRequest* load(FmFileInfo* fileInfo, int size, ThumbnailCallback callback, gpointer user_data, int priority = 0);
+  void cancel(ThumbnailRequest* request);
+
+  // Changing the priority of a queued request takes effect once
+  // updatePriorities() is called, so many can be changed at once.
+  static void setPriority(ThumbnailRequest* request, int priority);
+  void updatePriorities();
+
+  static FmFileInfo* fileInfo(ThumbnailRequest* request);
+  static int size(ThumbnailRequest* request);
+  // the mtime of the file when the request was made, the image shows that version
+  static qint64 mtime(ThumbnailRequest* request);
+  // null if no thumbnail could be generated
+  static QImage image(ThumbnailRequest* request);
+
+  int decoderCount() const {
+    return decodePool_.maxThreadCount();
+  }
+
+private Q_SLOTS:
+  void collectFinished();
+  void deliverResults();
+
+private:
+  bool canDecode(FmFileInfo* fileInfo) const;
+  void dispatch();
+  bool isCancelled(ThumbnailRequest* request) const;
+  void jobFinished(ThumbnailRequest* request); // called from the worker threads
+  static void onFallbackLoaded(FmThumbnailLoader* res, gpointer user_data);
+
+  friend class ThumbnailReadJob;
+  friend class ThumbnailDecodeJob;
+  friend class FallbackDecodeJob;
+
+private:
+  static ThumbnailEngine* theThumbnailEngine;
+  QThreadPool readPool_;
+  QThreadPool decodePool_;
+  QSet<QByteArray> mimeTypes_; // mime types QImageReader can decode
+  QSet<QByteArray> rawMimeTypes_; // camera RAW files, decoded from their previews
+  QByteArray cacheDir_; // ~/.cache/thumbnails
+  QList<ThumbnailRequest*> pending_; // waiting for a reader, sorted by priority
+  QSet<ThumbnailRequest*> fallbacks_; // being loaded by libfm
+  int inFlight_; // requests handed to the worker threads
+  int maxInFlight_; // bounds the memory held by files read ahead
+  QMutex finishedLock_;
+  QVector<ThumbnailRequest*> finished_; // done by the workers, guarded by finishedLock_
+  QVector<ThumbnailRequest*> ready_; // waiting to be delivered
+  QTimer* deliveryTimer_;
+  QAtomicInt shuttingDown_;
+};
+
+}
+
+#endif // FM_THUMBNAILENGINE_H
@@ -19,8 +19,15 @@
 
 
 #include "thumbnailloader.h"
+#include "filebuffer.h"
+#include "pnginfo.h"
+#include "thumbnailscaler.h"
 #include <new>
+#include <limits.h>
+#include <string.h>
+#include <QBuffer>
 #include <QByteArray>
+#include <QFile>
 
 using namespace Fm;
 
@@ -43,6 +50,11 @@ typedef struct _FmQImageWrapperClass        FmQImageWrapperClass;
 struct _FmQImageWrapper {
   GObject parent;
   QImage image;
+  // A cached thumbnail read by readImageFromFile() is only decoded once its
+  // pixels are needed. libfm checks its Thumb::MTime first, which is taken
+  // from the PNG header, and outdated thumbnails are never decoded.
+  QByteArray png;
+  PngInfo pngInfo;
 };
 
 struct _FmQImageWrapperClass {
@@ -61,14 +73,18 @@ static void fm_qimage_wrapper_class_init(FmQImageWrapperClass *klass) {
 }
 
 static void fm_qimage_wrapper_init(FmQImageWrapper *self) {
-  // placement new for QImage
+  // placement new for the C++ members
   new(&self->image) QImage();
+  new(&self->png) QByteArray();
+  new(&self->pngInfo) PngInfo();
 }
 
 static void fm_qimage_wrapper_finalize(GObject *self) {
   FmQImageWrapper *wrapper = FM_QIMAGE_WRAPPER(self);
   // placement delete
   wrapper->image.~QImage();
+  wrapper->png.~QByteArray();
+  wrapper->pngInfo.~PngInfo();
 }
 
 GObject *fm_qimage_wrapper_new(QImage& image) {
@@ -77,6 +93,15 @@ GObject *fm_qimage_wrapper_new(QImage& image) {
   return (GObject*)wrapper;
 }
 
+// the image of the wrapper, decoding a deferred PNG first
+static QImage& wrapperImage(FmQImageWrapper* wrapper) {
+  if(!wrapper->png.isNull()) {
+    wrapper->image = QImage::fromData(wrapper->png, "PNG");
+    wrapper->png = QByteArray();
+  }
+  return wrapper->image;
+}
+
 ThumbnailLoader* ThumbnailLoader::theThumbnailLoader = NULL;
 bool ThumbnailLoader::localFilesOnly_ = true;
 int ThumbnailLoader::maxThumbnailFileSize_ = 0;
@@ -104,9 +129,88 @@ ThumbnailLoader::~ThumbnailLoader() {
 
 }
 
+// libfm scales what we read to its cached thumbnail sizes, the largest is 256
+static const int largestThumbnailSize = 256;
+
+QImage ThumbnailLoader::readScaledImage(QImageReader& reader, int size, int* orientation) {
+  if(orientation) {
+    *orientation = 1;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    switch(reader.transformation()) {
+    case QImageIOHandler::TransformationMirror: *orientation = 2; break;
+    case QImageIOHandler::TransformationRotate180: *orientation = 3; break;
+    case QImageIOHandler::TransformationFlip: *orientation = 4; break;
+    case QImageIOHandler::TransformationFlipAndRotate90: *orientation = 5; break;
+    case QImageIOHandler::TransformationRotate90: *orientation = 6; break;
+    case QImageIOHandler::TransformationMirrorAndRotate90: *orientation = 7; break;
+    case QImageIOHandler::TransformationRotate270: *orientation = 8; break;
+    default: break;
+    }
+#endif
+  }
+  QSize imageSize = reader.size();
+  // without support in the format plugin, QImageReader would scale the full image itself
+  if(imageSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+    QSize decodeSize = imageSize.scaled(size * 2, size * 2, Qt::KeepAspectRatio);
+    if(decodeSize.width() < imageSize.width())
+      reader.setScaledSize(decodeSize);
+  }
+  return reader.read();
+}
+
+// libfm asks for the "orientation" text and rotates the image with rotateImage()
+static QImage readThumbnailSource(QImageReader& reader) {
+  int orientation;
+  QImage image = ThumbnailLoader::readScaledImage(reader, largestThumbnailSize, &orientation);
+  if(!image.isNull() && orientation != 1)
+    image.setText(QStringLiteral("orientation"), QString::number(orientation));
+  return image;
+}
+
+static QImage readThumbnailSource(const QByteArray& data) {
+  QByteArray bytes = data;
+  QBuffer device(&bytes);
+  device.open(QIODevice::ReadOnly);
+  QImageReader reader(&device);
+  return readThumbnailSource(reader);
+}
+
+// the thumbnail cache, whose PNG files are handed back to libfm undecoded
+static const QByteArray& thumbnailCacheDir() {
+  static const QByteArray dir = QByteArray(g_get_user_cache_dir()) + "/thumbnails/";
+  return dir;
+}
+
 GObject* ThumbnailLoader::readImageFromFile(const char* filename) {
   QImage image;
-  image.load(QString(filename));
+  if(strncmp(filename, thumbnailCacheDir().constData(), thumbnailCacheDir().size()) == 0) {
+    QFile file(QFile::decodeName(filename));
+    if(!file.open(QIODevice::ReadOnly))
+      return NULL;
+    QByteArray data = file.readAll();
+    // libfm reads the cached thumbnails with this as well, put off decoding them
+    PngInfo info;
+    if(readPngInfo(data.constData(), data.size(), &info) && info.text.contains("Thumb::MTime")) {
+      QImage empty;
+      FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(fm_qimage_wrapper_new(empty));
+      wrapper->png = data;
+      wrapper->pngInfo = info;
+      return (GObject*)wrapper;
+    }
+    image = readThumbnailSource(data);
+  }
+  else {
+    // read other local files in one go into a buffer from the pool
+    QByteArray data;
+    if(readWholeFile(filename, &data)) {
+      image = readThumbnailSource(data);
+      returnFileBuffer(data);
+    }
+    else {
+      QImageReader reader(QString(filename));
+      image = readThumbnailSource(reader);
+    }
+  }
   // qDebug("readImageFromFile: %s, %d", filename, image.isNull());
   return image.isNull() ? NULL : fm_qimage_wrapper_new(image);
 }
@@ -114,28 +218,24 @@ GObject* ThumbnailLoader::readImageFromFile(const char* filename) {
 GObject* ThumbnailLoader::readImageFromStream(GInputStream* stream, guint64 len, GCancellable* cancellable) {
   // qDebug("readImageFromStream: %p, %llu", stream, len);
   // FIXME: should we set a limit here? Otherwise if len is too large, we can run out of memory.
-  unsigned char* buffer = new unsigned char[len]; // allocate enough buffer
-  unsigned char* pbuffer = buffer;
-  int totalReadSize = 0;
-  while(!g_cancellable_is_cancelled(cancellable) && totalReadSize < len) {
-    int bytesToRead = totalReadSize + 4096 > len ? len - totalReadSize : 4096;
-    gssize readSize = g_input_stream_read(stream, pbuffer, bytesToRead, cancellable, NULL);
-    if(readSize == 0) // end of file
-      break;
-    else if(readSize == -1) // error
-      return NULL;
-    totalReadSize += readSize;
-    pbuffer += readSize;
-  }
+  if(len == 0 || len > INT_MAX)
+    return NULL;
+  QByteArray buffer = takeFileBuffer(int(len));
+  // read it all with as few calls as the stream allows
+  gsize totalReadSize = 0;
+  gboolean success = g_input_stream_read_all(stream, buffer.data(), len, &totalReadSize, cancellable, NULL);
   QImage image;
-  image.loadFromData(buffer, totalReadSize);
-  delete []buffer;
+  if(success && totalReadSize > 0) {
+    buffer.resize(int(totalReadSize));
+    image = readThumbnailSource(buffer);
+  }
+  returnFileBuffer(buffer);
   return image.isNull() ? NULL : fm_qimage_wrapper_new(image);
 }
 
 gboolean ThumbnailLoader::writeImage(GObject* image, const char* filename) {
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(image);
-  if(wrapper == NULL || wrapper->image.isNull())
+  if(wrapper == NULL || wrapperImage(wrapper).isNull())
     return FALSE;
   return (gboolean)wrapper->image.save(filename, "PNG");
 }
@@ -143,38 +243,44 @@ gboolean ThumbnailLoader::writeImage(GObject* image, const char* filename) {
 GObject* ThumbnailLoader::scaleImage(GObject* ori_pix, int new_width, int new_height) {
   // qDebug("scaleImage: %d, %d", new_width, new_height);
   FmQImageWrapper* ori_wrapper = FM_QIMAGE_WRAPPER(ori_pix);
-  QImage scaled = ori_wrapper->image.scaled(new_width, new_height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+  QImage scaled = Fm::scaleImage(wrapperImage(ori_wrapper), new_width, new_height);
   return scaled.isNull() ? NULL : fm_qimage_wrapper_new(scaled);
 }
 
 GObject* ThumbnailLoader::rotateImage(GObject* image, int degree) {
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(image);
   // degree values are 0, 90, 180, and 270 counterclockwise.
-  // In Qt, QMatrix does rotation counterclockwise as well.
-  // However, because the y axis of widget coordinate system is downward,
-  // the real effect of the coordinate transformation becomes clockwise rotation.
-  // So we need to use (360 - degree) here.
-  // Quote from QMatrix API doc:
-  // Note that if you apply a QMatrix to a point defined in widget
-  // coordinates, the direction of the rotation will be clockwise because
-  // the y-axis points downwards.
-  QImage rotated = wrapper->image.transformed(QMatrix().rotate(360 - degree));
+  // Turn them into the EXIF orientation the image is stored in.
+  int orientation;
+  switch(degree) {
+  case 90: orientation = 8; break;
+  case 180: orientation = 3; break;
+  case 270: orientation = 6; break;
+  default: orientation = 1; break;
+  }
+  const QImage& ori = wrapperImage(wrapper);
+  bool transposed = (degree == 90 || degree == 270);
+  QImage rotated = Fm::scaleImage(ori, transposed ? ori.height() : ori.width(), transposed ? ori.width() : ori.height(), orientation);
   return rotated.isNull() ? NULL : fm_qimage_wrapper_new(rotated);
 }
 
 int ThumbnailLoader::getImageWidth(GObject* image) {
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(image);
-  return wrapper->image.width();
+  return wrapper->png.isNull() ? wrapper->image.width() : wrapper->pngInfo.width;
 }
 
 int ThumbnailLoader::getImageHeight(GObject* image) {
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(image);
-  return wrapper->image.height();
+  return wrapper->png.isNull() ? wrapper->image.height() : wrapper->pngInfo.height;
 }
 
 char* ThumbnailLoader::getImageText(GObject* image, const char* key) {
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(image);
-  QByteArray text = wrapper->image.text(key).toLatin1();
+  QByteArray text;
+  if(!wrapper->png.isNull() && wrapper->pngInfo.text.contains(key))
+    text = wrapper->pngInfo.text.value(key);
+  else
+    text = wrapperImage(wrapper).text(key).toLatin1();
   return (char*)g_memdup(text.constData(), text.length());
 }
 
@@ -182,7 +288,7 @@ gboolean ThumbnailLoader::setImageText(GObject* image, const char* key, const ch
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(image);
   // NOTE: we might receive image=NULL sometimes with older versions of libfm.
   if(Q_LIKELY(wrapper != NULL)) {
-    wrapper->image.setText(key, val);
+    wrapperImage(wrapper).setText(key, val);
   }
   return TRUE;
 }
@@ -190,8 +296,13 @@ gboolean ThumbnailLoader::setImageText(GObject* image, const char* key, const ch
 QImage ThumbnailLoader::image(FmThumbnailLoader* result) {
   FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(fm_thumbnail_loader_get_data(result));
   if(wrapper) {
-    return wrapper->image;
+    return wrapperImage(wrapper);
   }
   return QImage();
 }
 
+QByteArray ThumbnailLoader::encodedImage(FmThumbnailLoader* result) {
+  FmQImageWrapper* wrapper = FM_QIMAGE_WRAPPER(fm_thumbnail_loader_get_data(result));
+  return wrapper ? wrapper->png : QByteArray();
+}
+
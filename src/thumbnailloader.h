@@ -23,6 +23,7 @@
 
 #include "libfmqtglobals.h"
 #include <QImage>
+#include <QImageReader>
 #include <libfm/fm.h>
 #include <gio/gio.h>
 
@@ -53,6 +54,11 @@ public:
 
   static QImage image(FmThumbnailLoader* result);
 
+  // The PNG data of a thumbnail libfm took from its cache, if decoding it was
+  // put off, or a null array if image() does not need to decode anything.
+  // Unlike image(), the data may be decoded in another thread.
+  static QByteArray encodedImage(FmThumbnailLoader* result);
+
   static int size(FmThumbnailLoader* result) {
     return fm_thumbnail_loader_get_size(result);
   }
@@ -77,6 +83,13 @@ public:
       fm_config->thumbnail_max = maxThumbnailFileSize_;
   }
 
+  // Read an image which is shown no larger than size x size. Formats which can
+  // scale while decoding, like JPEG with its DCT scaling, are decoded at about
+  // twice that size instead of full resolution. The caller does the final
+  // smooth scaling. The image is not turned upright, its EXIF orientation (1-8)
+  // is stored in orientation if that is not NULL.
+  static QImage readScaledImage(QImageReader& reader, int size, int* orientation = NULL);
+
 private:
   static GObject* readImageFromFile(const char* filename);
   static GObject* readImageFromStream(GInputStream* stream, guint64 len, GCancellable* cancellable);
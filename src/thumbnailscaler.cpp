@@ -0,0 +1,246 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "thumbnailscaler.h"
+#include <QVector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Fm {
+
+// Average each 2x2 block of 32 bit pixels in two source rows into one pixel.
+// The channels are summed as 16 bit integers, so the result is rounded once.
+static void halveRow(const quint32* row0, const quint32* row1, quint32* out, int width) {
+  int x = 0;
+#if defined(__AVX2__)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+    for(; x + 4 <= width; x += 4) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 2 * x));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 2 * x));
+      // in each 128 bit lane: pixels 0 and 1 in lo, 2 and 3 in hi, both rows added
+      __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+      __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+      // add the horizontal neighbours
+      lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+      hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+      __m256i sum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), two), 2);
+      // two result pixels are in the low half of each lane, gather them
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm256_castsi256_si128(packed));
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for(; x + 2 <= width; x += 2) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 2 * x));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 2 * x));
+      __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+      __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+      lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+      hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+      __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+    }
+  }
+#endif
+  for(; x < width; ++x) {
+    quint32 p[4] = {row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1]};
+    quint32 result = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+      quint32 sum = 2;
+      for(int i = 0; i < 4; ++i)
+        sum += (p[i] >> shift) & 0xff;
+      result |= (sum >> 2) << shift;
+    }
+    out[x] = result;
+  }
+}
+
+// Average a block of cols x rows pixels starting at (x, y), rounded.
+static quint32 averageBlock(const QImage& image, int x, int y, int cols, int rows) {
+  quint32 sum[4] = {0, 0, 0, 0};
+  for(int v = y; v < y + rows; ++v) {
+    const quint32* row = reinterpret_cast<const quint32*>(image.constScanLine(v));
+    for(int u = x; u < x + cols; ++u) {
+      for(int i = 0; i < 4; ++i)
+        sum[i] += (row[u] >> (8 * i)) & 0xff;
+    }
+  }
+  int count = cols * rows;
+  quint32 result = 0;
+  for(int i = 0; i < 4; ++i)
+    result |= ((sum[i] + count / 2) / count) << (8 * i);
+  return result;
+}
+
+// Halve the image with a 2x2 box filter. If the width or height is odd, the
+// last pixels of the result average three columns or rows instead, so the
+// edge is neither lost nor given the weight of a whole pixel.
+static QImage halveImage(const QImage& image) {
+  int width = image.width() / 2;
+  int height = image.height() / 2;
+  bool oddWidth = image.width() & 1;
+  bool oddHeight = image.height() & 1;
+  QImage result(width, height, image.format());
+  for(int y = 0; y < height; ++y) {
+    quint32* out = reinterpret_cast<quint32*>(result.scanLine(y));
+    if(oddHeight && y == height - 1) {
+      for(int x = 0; x < width; ++x)
+        out[x] = averageBlock(image, 2 * x, 2 * y, oddWidth && x == width - 1 ? 3 : 2, 3);
+      continue;
+    }
+    halveRow(reinterpret_cast<const quint32*>(image.constScanLine(2 * y)),
+             reinterpret_cast<const quint32*>(image.constScanLine(2 * y + 1)),
+             out, width);
+    if(oddWidth)
+      out[width - 1] = averageBlock(image, 2 * (width - 1), 2 * y, 3, 2);
+  }
+  return result;
+}
+
+// the two source pixels a target pixel is interpolated from along one axis
+struct Tap {
+  int first;
+  int second;
+  int weight; // of second, 0-256
+};
+
+static QVector<Tap> computeTaps(int sourceSize, int targetSize) {
+  QVector<Tap> taps(targetSize);
+  double scale = double(sourceSize) / targetSize;
+  for(int i = 0; i < targetSize; ++i) {
+    // sample at the centre of the target pixel
+    double pos = (i + 0.5) * scale - 0.5;
+    if(pos < 0)
+      pos = 0;
+    Tap& tap = taps[i];
+    tap.first = int(pos);
+    if(tap.first >= sourceSize - 1) {
+      tap.first = tap.second = sourceSize - 1;
+      tap.weight = 0;
+    }
+    else {
+      tap.second = tap.first + 1;
+      tap.weight = int((pos - tap.first) * 256 + 0.5);
+    }
+  }
+  return taps;
+}
+
+// blend two pixels, two channels at a time
+static inline quint32 interpolate(quint32 a, quint32 b, int weight) {
+  quint32 rb = (((a & 0xff00ff) * (256 - weight) + (b & 0xff00ff) * weight) >> 8) & 0xff00ff;
+  quint32 ag = (((a >> 8) & 0xff00ff) * (256 - weight) + ((b >> 8) & 0xff00ff) * weight) & 0xff00ff00;
+  return rb | ag;
+}
+
+QImage scaleImage(const QImage& image, int width, int height, int orientation) {
+  if(image.isNull() || width <= 0 || height <= 0)
+    return QImage();
+  if(orientation < 1 || orientation > 8)
+    orientation = 1;
+  // orientations 5 to 8 swap the axes, the target size is upright
+  bool transposed = orientation >= 5;
+  int scaledWidth = transposed ? height : width;
+  int scaledHeight = transposed ? width : height;
+  if(orientation == 1 && scaledWidth == image.width() && scaledHeight == image.height())
+    return image;
+
+  // premultiplied, so transparent pixels do not bleed their color when averaged
+  QImage::Format format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+  QImage source = image.convertToFormat(format);
+  while(source.width() >= scaledWidth * 2 && source.height() >= scaledHeight * 2)
+    source = halveImage(source);
+
+  // Target pixel (x, y) of the upright image is pixel (u, v) of the image
+  // scaled in the stored orientation, with u = u0 + x * ux + y * uy and
+  // v = v0 + x * vx + y * vy.
+  int lastU = scaledWidth - 1, lastV = scaledHeight - 1;
+  int u0 = 0, ux = 1, uy = 0, v0 = 0, vx = 0, vy = 1;
+  switch(orientation) {
+  case 2: // mirrored
+    u0 = lastU; ux = -1;
+    break;
+  case 3: // rotated by 180 degrees
+    u0 = lastU; ux = -1; v0 = lastV; vy = -1;
+    break;
+  case 4: // flipped
+    v0 = lastV; vy = -1;
+    break;
+  case 5: // transposed
+    ux = 0; uy = 1; vx = 1; vy = 0;
+    break;
+  case 6: // needs to be rotated 90 degrees clockwise
+    ux = 0; uy = 1; v0 = lastV; vx = -1; vy = 0;
+    break;
+  case 7: // transversed
+    u0 = lastU; ux = 0; uy = -1; v0 = lastV; vx = -1; vy = 0;
+    break;
+  case 8: // needs to be rotated 90 degrees counterclockwise
+    u0 = lastU; ux = 0; uy = -1; vx = 1; vy = 0;
+    break;
+  }
+
+  QVector<Tap> uTaps = computeTaps(source.width(), scaledWidth);
+  QVector<Tap> vTaps = computeTaps(source.height(), scaledHeight);
+  const uchar* bits = source.constBits();
+  int stride = source.bytesPerLine();
+  QImage result(width, height, format);
+  for(int y = 0; y < height; ++y) {
+    quint32* out = reinterpret_cast<quint32*>(result.scanLine(y));
+    int u = u0 + y * uy;
+    int v = v0 + y * vy;
+    for(int x = 0; x < width; ++x, u += ux, v += vx) {
+      const Tap& uTap = uTaps[u];
+      const Tap& vTap = vTaps[v];
+      const quint32* row0 = reinterpret_cast<const quint32*>(bits + vTap.first * stride);
+      const quint32* row1 = reinterpret_cast<const quint32*>(bits + vTap.second * stride);
+      out[x] = interpolate(interpolate(row0[uTap.first], row0[uTap.second], uTap.weight),
+                           interpolate(row1[uTap.first], row1[uTap.second], uTap.weight), vTap.weight);
+    }
+  }
+  return result;
+}
+
+QImage scaleThumbnail(const QImage& image, int size, int orientation) {
+  bool transposed = orientation >= 5 && orientation <= 8;
+  int width = transposed ? image.height() : image.width();
+  int height = transposed ? image.width() : image.height();
+  if(width > size || height > size) {
+    // keep the aspect ratio
+    if(width >= height) {
+      height = qMax(1, int(qint64(height) * size / width));
+      width = size;
+    }
+    else {
+      width = qMax(1, int(qint64(width) * size / height));
+      height = size;
+    }
+  }
+  return scaleImage(image, width, height, orientation);
+}
+
+}
@@ -0,0 +1,41 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_THUMBNAILSCALER_H
+#define FM_THUMBNAILSCALER_H
+
+#include "libfmqtglobals.h"
+#include <QImage>
+
+namespace Fm {
+
+// Scale image to width x height and turn it upright according to its EXIF
+// orientation (1-8) in the same pass. width and height are the size of the
+// upright result. While the image is at least twice as large as needed it is
+// halved with a 2x2 box filter, using SSE2 or AVX2 when the compiler targets
+// them. The remaining step is bilinear, and the rotation or mirroring is done
+// by the order in which that step writes the pixels.
+LIBFM_QT_API QImage scaleImage(const QImage& image, int width, int height, int orientation = 1);
+
+// Scale image down to fit in size x size, keeping its aspect ratio, and turn
+// it upright. Smaller images are only turned upright.
+LIBFM_QT_API QImage scaleThumbnail(const QImage& image, int size, int orientation = 1);
+
+}
+
+#endif // FM_THUMBNAILSCALER_H
@@ -0,0 +1,263 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "volumelabelresolver.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QRunnable>
+#include <QStringList>
+#include <gio/gunixmounts.h>
+
+using namespace Fm;
+
+static VolumeLabelResolver* theVolumeLabelResolver = NULL; // the global single instance
+
+#ifdef __FreeBSD__
+
+// "fstyp -l" prints the file system type optionally followed by the label.
+// Without a label, the file system type is used so the volume still gets a
+// more useful name than its device node.
+static QString labelFromFstypOutput(QString result) {
+  result.replace("\n", "");
+  result = result.trimmed();
+  QStringList parts = result.split(" ");
+  if(parts.length() == 1)
+    return parts[0];
+  else if(parts.length() == 2)
+    return parts[1];
+  return QString();
+}
+
+#elif defined(__linux__)
+
+// udev escapes unsafe characters in the link names as \xNN
+static QString unescapeUdevName(const QString& name) {
+  QByteArray in = QFile::encodeName(name);
+  QByteArray out;
+  out.reserve(in.size());
+  for(int i = 0; i < in.size(); ++i) {
+    if(in[i] == '\\' && i + 3 < in.size() && in[i + 1] == 'x') {
+      bool ok;
+      int ch = in.mid(i + 2, 2).toInt(&ok, 16);
+      if(ok) {
+        out.append(char(ch));
+        i += 3;
+        continue;
+      }
+    }
+    out.append(in[i]);
+  }
+  return QString::fromUtf8(out);
+}
+
+namespace {
+
+// scans /dev/disk/by-label for a link pointing to the device
+class LabelLookupJob: public QRunnable {
+public:
+  LabelLookupJob(VolumeLabelResolver* resolver, int generation, const QString& device):
+    resolver_(resolver),
+    generation_(generation),
+    device_(device) {
+  }
+
+  void run() {
+    QString label;
+    QString devicePath = QFileInfo(device_).canonicalFilePath();
+    if(!devicePath.isEmpty()) {
+      QDir dir(QStringLiteral("/dev/disk/by-label"));
+      Q_FOREACH(const QFileInfo& link, dir.entryInfoList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot)) {
+        if(link.canonicalFilePath() == devicePath) {
+          label = unescapeUdevName(link.fileName());
+          break;
+        }
+      }
+    }
+    // deliver the result in the thread of the resolver
+    QMetaObject::invokeMethod(resolver_, "onLabelResolved", Qt::QueuedConnection,
+                              Q_ARG(int, generation_), Q_ARG(QString, device_), Q_ARG(QString, label));
+  }
+
+private:
+  VolumeLabelResolver* resolver_;
+  int generation_;
+  QString device_;
+};
+
+}
+
+#endif
+
+VolumeLabelResolver::VolumeLabelResolver():
+  volumeMonitor_(g_volume_monitor_get()),
+  generation_(0) {
+  // NOTE: only one instance is allowed
+  Q_ASSERT(theVolumeLabelResolver == NULL);
+  theVolumeLabelResolver = this;
+  threadPool_.setMaxThreadCount(1); // lookups are rare, keep them serialized
+
+  if(volumeMonitor_) {
+    g_signal_connect(volumeMonitor_, "mount-added", G_CALLBACK(onMountChanged), this);
+    g_signal_connect(volumeMonitor_, "mount-removed", G_CALLBACK(onMountChanged), this);
+  }
+}
+
+VolumeLabelResolver::~VolumeLabelResolver() {
+  if(volumeMonitor_) {
+    g_signal_handlers_disconnect_by_func(volumeMonitor_, (gpointer)G_CALLBACK(onMountChanged), this);
+    g_object_unref(volumeMonitor_);
+  }
+  // results posted by running jobs are discarded together with this object
+  threadPool_.waitForDone();
+  theVolumeLabelResolver = NULL;
+}
+
+VolumeLabelResolver* VolumeLabelResolver::instance() {
+  return theVolumeLabelResolver;
+}
+
+bool VolumeLabelResolver::label(const QString& device, QString* label) {
+  QHash<QString, QString>::const_iterator it = labels_.constFind(device);
+  if(it != labels_.constEnd()) {
+    *label = it.value();
+    return true;
+  }
+  if(!pending_.contains(device)) {
+    pending_.insert(device);
+    resolve(device);
+  }
+  return false;
+}
+
+static QString deviceForVolume(GVolume* volume) {
+  char* device = g_volume_get_identifier(volume, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE);
+  QString result = QString::fromUtf8(device);
+  g_free(device);
+  return result;
+}
+
+//static
+QString VolumeLabelResolver::deviceForMount(GMount* mount) {
+  QString device;
+  GVolume* volume = g_mount_get_volume(mount);
+  if(volume) {
+    device = deviceForVolume(volume);
+    g_object_unref(volume);
+  }
+  if(device.isEmpty()) {
+    // mounts without a volume, like the ones from fstab, are looked up by their mount point
+    GFile* root = g_mount_get_root(mount);
+    char* path = g_file_get_path(root);
+    if(path) {
+      GUnixMountEntry* entry = g_unix_mount_at(path, NULL);
+      if(entry) {
+        device = QString::fromUtf8(g_unix_mount_get_device_path(entry));
+        g_unix_mount_free(entry);
+      }
+      g_free(path);
+    }
+    g_object_unref(root);
+  }
+  if(!device.startsWith(QLatin1Char('/')))
+    device.clear();
+  return device;
+}
+
+QString VolumeLabelResolver::deviceForName(const QString& name) {
+  QString device;
+  if(volumeMonitor_) {
+    QByteArray utf8Name = name.toUtf8();
+    GList* volumes = g_volume_monitor_get_volumes(volumeMonitor_);
+    for(GList* l = volumes; l && device.isEmpty(); l = l->next) {
+      GVolume* volume = G_VOLUME(l->data);
+      char* volumeName = g_volume_get_name(volume);
+      if(volumeName && utf8Name == volumeName)
+        device = deviceForVolume(volume);
+      g_free(volumeName);
+    }
+    g_list_free_full(volumes, g_object_unref);
+
+    if(device.isEmpty()) {
+      GList* mounts = g_volume_monitor_get_mounts(volumeMonitor_);
+      for(GList* l = mounts; l && device.isEmpty(); l = l->next) {
+        GMount* mount = G_MOUNT(l->data);
+        char* mountName = g_mount_get_name(mount);
+        if(mountName && utf8Name == mountName)
+          device = deviceForMount(mount);
+        g_free(mountName);
+      }
+      g_list_free_full(mounts, g_object_unref);
+    }
+  }
+  if(device.isEmpty())
+    device = QStringLiteral("/dev/") + name;
+  return device;
+}
+
+void VolumeLabelResolver::invalidate() {
+  ++generation_;
+  labels_.clear();
+  pending_.clear();
+  Q_EMIT labelsInvalidated();
+}
+
+void VolumeLabelResolver::resolve(const QString& device) {
+  int generation = generation_;
+#ifdef __FreeBSD__
+  // NOTE: Alternatively, we could just use mountpoints that have the volume label as their name
+  QProcess* process = new QProcess(this);
+  connect(process, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this,
+          [this, process, generation, device](int, QProcess::ExitStatus) {
+    QString result = QString::fromUtf8(process->readAllStandardOutput());
+    onLabelResolved(generation, device, labelFromFstypOutput(result));
+    process->deleteLater();
+  });
+  connect(process, static_cast<void (QProcess::*)(QProcess::ProcessError)>(&QProcess::error), this,
+          [this, process, generation, device](QProcess::ProcessError error) {
+    // finished() is not emitted if the program cannot be started at all
+    if(error == QProcess::FailedToStart) {
+      onLabelResolved(generation, device, QString());
+      process->deleteLater();
+    }
+  });
+  process->start(QStringLiteral("fstyp"), QStringList() << QStringLiteral("-l") << device);
+#elif defined(__linux__)
+  threadPool_.start(new LabelLookupJob(this, generation, device));
+#else
+  // no source of volume labels on this OS
+  QMetaObject::invokeMethod(this, "onLabelResolved", Qt::QueuedConnection,
+                            Q_ARG(int, generation), Q_ARG(QString, device), Q_ARG(QString, QString()));
+#endif
+}
+
+void VolumeLabelResolver::onLabelResolved(int generation, const QString& device, const QString& label) {
+  if(generation != generation_) // the cache was invalidated in the meantime
+    return;
+  pending_.remove(device);
+  labels_.insert(device, label);
+  if(!label.isEmpty())
+    Q_EMIT labelResolved(device, label);
+}
+
+//static
+void VolumeLabelResolver::onMountChanged(GVolumeMonitor* monitor, GMount* mount, VolumeLabelResolver* pThis) {
+  pThis->invalidate();
+}
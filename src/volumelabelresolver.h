@@ -0,0 +1,80 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef FM_VOLUMELABELRESOLVER_H
+#define FM_VOLUMELABELRESOLVER_H
+
+#include "libfmqtglobals.h"
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <gio/gio.h>
+
+namespace Fm {
+
+// Looks up the volume labels of block devices without blocking the UI.
+// On FreeBSD "fstyp -l" is run asynchronously, on Linux /dev/disk/by-label
+// is scanned in a worker thread. Results are cached per device until a
+// volume is mounted or unmounted.
+class LIBFM_QT_API VolumeLabelResolver: public QObject {
+  Q_OBJECT
+public:
+  VolumeLabelResolver();
+  ~VolumeLabelResolver();
+
+  static VolumeLabelResolver* instance();
+
+  // Returns true and sets *label if the label of device (e.g. "/dev/da0p1") is
+  // known. The label is empty if the device has none. Otherwise false is returned,
+  // the lookup is started and labelResolved() is emitted when it finishes.
+  bool label(const QString& device, QString* label);
+
+  // The device node of the volume or mount called name, e.g. "/dev/sdb1" for
+  // "500 GB Volume". If there is none with that name, name is taken to be
+  // the name of the device node, as in the names FreeBSD gives to volumes.
+  QString deviceForName(const QString& name);
+  // the device node of the mount, or an empty string if it has none
+  static QString deviceForMount(GMount* mount);
+
+  // forget all cached labels
+  void invalidate();
+
+Q_SIGNALS:
+  void labelResolved(const QString& device, const QString& label);
+  void labelsInvalidated(); // cached labels are outdated and should be requested again
+
+private Q_SLOTS:
+  void onLabelResolved(int generation, const QString& device, const QString& label);
+
+private:
+  void resolve(const QString& device);
+  static void onMountChanged(GVolumeMonitor* monitor, GMount* mount, VolumeLabelResolver* pThis);
+
+private:
+  QHash<QString, QString> labels_;
+  QSet<QString> pending_;
+  GVolumeMonitor* volumeMonitor_;
+  QThreadPool threadPool_;
+  int generation_; // incremented by invalidate() so late results are dropped
+};
+
+}
+
+#endif // FM_VOLUMELABELRESOLVER_H
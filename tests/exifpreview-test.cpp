@@ -0,0 +1,408 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+// findEmbeddedPreview() on TIFF based RAW files and EXIF data put together
+// IFD by IFD, with JPEG images which have only their headers.
+
+#include "exifpreview.h"
+#include <QHash>
+#include <QTest>
+#include <QVector>
+
+class ExifPreviewTest: public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void previews_data();
+  void previews();
+  void subIfds();
+  void truncated();
+  void loopingIfds();
+  void losslessJpeg();
+  void aspectRatio();
+  void exifThumbnail();
+  void orientation_data();
+  void orientation();
+};
+
+enum {
+  TypeShort = 3,
+  TypeLong = 4,
+  TagCompression = 0x0103,
+  TagStripOffsets = 0x0111,
+  TagOrientation = 0x0112,
+  TagStripByteCounts = 0x0117,
+  TagSubIFDs = 0x014a,
+  TagJpegOffset = 0x0201,
+  TagJpegLength = 0x0202
+};
+
+struct IfdEntry {
+  quint16 tag;
+  quint16 type;
+  quint32 count;
+  quint32 value; // or the offset of the values
+};
+
+static IfdEntry entry(quint16 tag, quint16 type, quint32 value, quint32 count = 1) {
+  IfdEntry e;
+  e.tag = tag;
+  e.type = type;
+  e.count = count;
+  e.value = value;
+  return e;
+}
+
+// a preview in JPEGInterchangeFormat, like the thumbnails in IFD1
+static QVector<IfdEntry> jpegEntries(quint32 offset, int length) {
+  return QVector<IfdEntry>() << entry(TagJpegOffset, TypeLong, offset) << entry(TagJpegLength, TypeLong, length);
+}
+
+// a preview stored as the image of its IFD, in one strip
+static QVector<IfdEntry> stripEntries(quint32 offset, int length, int compression = 6) {
+  return QVector<IfdEntry>() << entry(TagCompression, TypeShort, compression)
+                             << entry(TagStripOffsets, TypeLong, offset)
+                             << entry(TagStripByteCounts, TypeLong, length);
+}
+
+// the headers of a JPEG file up to its frame header, frame being the SOF marker
+static QByteArray jpeg(int width, int height, uchar frame = 0xc0) {
+  static const char app0[] = "\xff\xe0\x00\x10JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00";
+  QByteArray data("\xff\xd8");
+  data.append(app0, sizeof(app0) - 1);
+  data.append(char(0xff)).append(char(frame)).append(char(0)).append(char(17)).append(char(8));
+  data.append(char(height >> 8)).append(char(height)).append(char(width >> 8)).append(char(width));
+  data.append("\x03\x01\x22\x00\x02\x11\x01\x03\x11\x01", 10);
+  data.append("\xff\xd9");
+  return data;
+}
+
+// writes a TIFF file in either byte order
+class TiffFile {
+public:
+  explicit TiffFile(bool bigEndian = false):
+    data_(bigEndian ? "MM" : "II"),
+    bigEndian_(bigEndian) {
+    append16(42);
+    append32(0);
+  }
+
+  void setFirstIfd(quint32 ifd) {
+    put32(4, ifd);
+  }
+
+  // returns the offset of the IFD
+  quint32 addIfd(const QVector<IfdEntry>& entries, quint32 next = 0) {
+    quint32 ifd = data_.size();
+    append16(entries.size());
+    Q_FOREACH(const IfdEntry& e, entries) {
+      append16(e.tag);
+      append16(e.type);
+      append32(e.count);
+      // a single SHORT is in the first half of the value
+      if(e.type == TypeShort && e.count == 1) {
+        append16(e.value);
+        append16(0);
+      }
+      else
+        append32(e.value);
+    }
+    nextIfdFields_.insert(ifd, data_.size());
+    append32(next);
+    return ifd;
+  }
+
+  void setNextIfd(quint32 ifd, quint32 next) {
+    put32(nextIfdFields_.value(ifd), next);
+  }
+
+  quint32 addLongs(const QVector<quint32>& values) {
+    quint32 offset = data_.size();
+    Q_FOREACH(quint32 value, values)
+      append32(value);
+    return offset;
+  }
+
+  quint32 addData(const QByteArray& data) {
+    quint32 offset = data_.size();
+    data_.append(data);
+    return offset;
+  }
+
+  const QByteArray& data() const {
+    return data_;
+  }
+
+private:
+  void put16(int pos, quint16 value) {
+    data_[pos + (bigEndian_ ? 0 : 1)] = char(value >> 8);
+    data_[pos + (bigEndian_ ? 1 : 0)] = char(value);
+  }
+
+  void put32(int pos, quint32 value) {
+    put16(pos + (bigEndian_ ? 0 : 2), quint16(value >> 16));
+    put16(pos + (bigEndian_ ? 2 : 0), quint16(value));
+  }
+
+  void append16(quint16 value) {
+    data_.resize(data_.size() + 2);
+    put16(data_.size() - 2, value);
+  }
+
+  void append32(quint32 value) {
+    data_.resize(data_.size() + 4);
+    put32(data_.size() - 4, value);
+  }
+
+  QByteArray data_;
+  bool bigEndian_;
+  QHash<quint32, int> nextIfdFields_;
+};
+
+static bool find(const QByteArray& data, int minSize, Fm::EmbeddedPreview* preview) {
+  return Fm::findEmbeddedPreview(data.constData(), data.size(), minSize, preview);
+}
+
+// the preview found is where the JPEG of the expected size is
+static bool isJpeg(const QByteArray& data, const Fm::EmbeddedPreview& preview, int width, int height) {
+  return preview.width == width && preview.height == height
+         && data.mid(preview.offset, preview.length) == jpeg(width, height);
+}
+
+// A RAW file with a small thumbnail in IFD0 and a large preview in IFD1.
+static QByteArray makeRaw(bool bigEndian) {
+  TiffFile tiff(bigEndian);
+  QByteArray thumbnail = jpeg(160, 120);
+  QByteArray large = jpeg(1600, 1200);
+  quint32 thumbnailOffset = tiff.addData(thumbnail);
+  quint32 largeOffset = tiff.addData(large);
+  quint32 ifd1 = tiff.addIfd(stripEntries(largeOffset, large.size()));
+  tiff.setFirstIfd(tiff.addIfd(jpegEntries(thumbnailOffset, thumbnail.size()), ifd1));
+  return tiff.data();
+}
+
+void ExifPreviewTest::previews_data() {
+  QTest::addColumn<bool>("bigEndian");
+  QTest::newRow("little endian") << false;
+  QTest::newRow("big endian") << true;
+}
+
+void ExifPreviewTest::previews() {
+  QFETCH(bool, bigEndian);
+  QByteArray data = makeRaw(bigEndian);
+  Fm::EmbeddedPreview preview;
+  // the smallest one which is large enough
+  QVERIFY(find(data, 128, &preview));
+  QVERIFY(isJpeg(data, preview, 160, 120));
+  QCOMPARE(preview.orientation, 1);
+  QVERIFY(find(data, 256, &preview));
+  QVERIFY(isJpeg(data, preview, 1600, 1200));
+  QVERIFY(!find(data, 2000, &preview));
+}
+
+void ExifPreviewTest::subIfds() {
+  TiffFile tiff;
+  QByteArray small = jpeg(320, 240);
+  QByteArray medium = jpeg(640, 480);
+  QByteArray large = jpeg(1280, 960);
+  quint32 smallIfd = tiff.addIfd(stripEntries(tiff.addData(small), small.size()));
+  quint32 mediumIfd = tiff.addIfd(jpegEntries(tiff.addData(medium), medium.size()));
+  quint32 largeIfd = tiff.addIfd(stripEntries(tiff.addData(large), large.size()));
+  // a single offset is in the entry itself, more are pointed to
+  quint32 offsets = tiff.addLongs(QVector<quint32>() << smallIfd << mediumIfd);
+  quint32 ifd1 = tiff.addIfd(QVector<IfdEntry>() << entry(TagSubIFDs, TypeLong, largeIfd));
+  tiff.setFirstIfd(tiff.addIfd(QVector<IfdEntry>() << entry(TagSubIFDs, TypeLong, offsets, 2), ifd1));
+  QByteArray data = tiff.data();
+  Fm::EmbeddedPreview preview;
+  QVERIFY(find(data, 300, &preview));
+  QVERIFY(isJpeg(data, preview, 320, 240));
+  QVERIFY(find(data, 400, &preview));
+  QVERIFY(isJpeg(data, preview, 640, 480));
+  QVERIFY(find(data, 1000, &preview));
+  QVERIFY(isJpeg(data, preview, 1280, 960));
+}
+
+// Files cut short, as while they are copied, are read up to where they end.
+void ExifPreviewTest::truncated() {
+  QByteArray data = makeRaw(false);
+  Fm::EmbeddedPreview preview;
+  for(int size = 0; size < data.size(); ++size) {
+    QByteArray part = data.left(size);
+    if(find(part, 128, &preview)) {
+      QVERIFY(preview.offset >= 0 && preview.length <= size - preview.offset);
+      QVERIFY(isJpeg(part, preview, 160, 120));
+    }
+  }
+
+  // previews running past the end of the file, or cut before their size
+  TiffFile tiff;
+  QByteArray thumbnail = jpeg(160, 120);
+  QByteArray large = jpeg(1600, 1200);
+  quint32 largeOffset = tiff.addData(large);
+  quint32 ifd2 = tiff.addIfd(stripEntries(largeOffset, 20));
+  quint32 ifd1 = tiff.addIfd(stripEntries(largeOffset, 0x7fffffff), ifd2);
+  tiff.setFirstIfd(tiff.addIfd(jpegEntries(tiff.addData(thumbnail), thumbnail.size()), ifd1));
+  QVERIFY(find(tiff.data(), 128, &preview));
+  QVERIFY(isJpeg(tiff.data(), preview, 160, 120));
+  QVERIFY(!find(tiff.data(), 256, &preview));
+
+  // an IFD with more entries than the file holds, the ones there are read
+  QByteArray broken = tiff.data();
+  broken[broken.size() - 4 - 2 * 12 - 2] = char(200);
+  QVERIFY(find(broken, 128, &preview));
+  QVERIFY(isJpeg(broken, preview, 160, 120));
+  // and a first IFD behind the end
+  tiff.setFirstIfd(0xfffffff0);
+  QVERIFY(!find(tiff.data(), 128, &preview));
+}
+
+void ExifPreviewTest::loopingIfds() {
+  TiffFile tiff;
+  QByteArray thumbnail = jpeg(160, 120);
+  quint32 ifd0 = tiff.addIfd(jpegEntries(tiff.addData(thumbnail), thumbnail.size()));
+  quint32 ifd1 = tiff.addIfd(QVector<IfdEntry>() << entry(TagCompression, TypeShort, 1), ifd0);
+  tiff.setNextIfd(ifd0, ifd1);
+  tiff.setFirstIfd(ifd0);
+  Fm::EmbeddedPreview preview;
+  QVERIFY(find(tiff.data(), 128, &preview));
+  QVERIFY(isJpeg(tiff.data(), preview, 160, 120));
+
+  // a sub-IFD which is its own parent, and lists itself many times
+  TiffFile self;
+  quint32 thumbnailOffset = self.addData(thumbnail);
+  QVector<quint32> offsets;
+  for(int i = 0; i < 100; ++i)
+    offsets << self.data().size() + 100 * 4;
+  quint32 list = self.addLongs(offsets);
+  QVector<IfdEntry> entries = QVector<IfdEntry>() << entry(TagSubIFDs, TypeLong, list, offsets.size());
+  quint32 ifd = self.addIfd(entries + jpegEntries(thumbnailOffset, thumbnail.size()));
+  QCOMPARE(ifd, offsets.first());
+  self.setFirstIfd(ifd);
+  QVERIFY(find(self.data(), 128, &preview));
+  QVERIFY(isJpeg(self.data(), preview, 160, 120));
+}
+
+// Some RAW files store their raw data as lossless JPEG, which is not a preview.
+void ExifPreviewTest::losslessJpeg() {
+  TiffFile tiff;
+  QByteArray raw = jpeg(4000, 3000, 0xc3);
+  QByteArray thumbnail = jpeg(160, 120);
+  quint32 rawIfd = tiff.addIfd(stripEntries(tiff.addData(raw), raw.size(), 7));
+  tiff.setFirstIfd(tiff.addIfd(QVector<IfdEntry>() << entry(TagSubIFDs, TypeLong, rawIfd)));
+  Fm::EmbeddedPreview preview;
+  QVERIFY(!find(tiff.data(), 128, &preview));
+
+  tiff.setFirstIfd(tiff.addIfd(QVector<IfdEntry>() << entry(TagSubIFDs, TypeLong, rawIfd)
+                                                   << jpegEntries(tiff.addData(thumbnail), thumbnail.size())));
+  QVERIFY(find(tiff.data(), 128, &preview));
+  QVERIFY(isJpeg(tiff.data(), preview, 160, 120));
+  QVERIFY(!find(tiff.data(), 200, &preview));
+
+  // nor is an uncompressed strip
+  TiffFile plain;
+  QByteArray image = jpeg(640, 480);
+  plain.setFirstIfd(plain.addIfd(stripEntries(plain.addData(image), image.size(), 1)));
+  QVERIFY(!find(plain.data(), 128, &preview));
+}
+
+// Previews letterboxed to another aspect ratio than the photo are skipped.
+void ExifPreviewTest::aspectRatio() {
+  TiffFile tiff;
+  QByteArray letterboxed = jpeg(160, 120);
+  QByteArray close = jpeg(300, 201); // 0.5% off
+  QByteArray large = jpeg(6000, 4000);
+  quint32 largeIfd = tiff.addIfd(stripEntries(tiff.addData(large), large.size()));
+  quint32 closeIfd = tiff.addIfd(jpegEntries(tiff.addData(close), close.size()), largeIfd);
+  tiff.setFirstIfd(tiff.addIfd(jpegEntries(tiff.addData(letterboxed), letterboxed.size()), closeIfd));
+  Fm::EmbeddedPreview preview;
+  QVERIFY(find(tiff.data(), 128, &preview));
+  QVERIFY(isJpeg(tiff.data(), preview, 300, 201));
+  QVERIFY(find(tiff.data(), 400, &preview));
+  QVERIFY(isJpeg(tiff.data(), preview, 6000, 4000));
+
+  // 2.5% off is too much
+  TiffFile wide;
+  QByteArray off = jpeg(300, 195);
+  quint32 wideIfd = wide.addIfd(stripEntries(wide.addData(large), large.size()));
+  wide.setFirstIfd(wide.addIfd(jpegEntries(wide.addData(off), off.size()), wideIfd));
+  QVERIFY(find(wide.data(), 128, &preview));
+  QVERIFY(isJpeg(wide.data(), preview, 6000, 4000));
+}
+
+// JPEG photos have their thumbnail in the EXIF data of an APP1 segment.
+static QByteArray makePhoto(int width, int height, int thumbnailWidth, int thumbnailHeight) {
+  TiffFile tiff(true);
+  QByteArray thumbnail = jpeg(thumbnailWidth, thumbnailHeight);
+  quint32 ifd1 = tiff.addIfd(jpegEntries(tiff.addData(thumbnail), thumbnail.size()));
+  tiff.setFirstIfd(tiff.addIfd(QVector<IfdEntry>() << entry(TagOrientation, TypeShort, 8), ifd1));
+  int length = 2 + 6 + tiff.data().size();
+  QByteArray data("\xff\xd8\xff\xe1");
+  data.append(char(length >> 8)).append(char(length)).append("Exif\0\0", 6).append(tiff.data());
+  return data + jpeg(width, height).mid(2);
+}
+
+void ExifPreviewTest::exifThumbnail() {
+  QByteArray data = makePhoto(4000, 3000, 160, 120);
+  Fm::EmbeddedPreview preview;
+  QVERIFY(find(data, 128, &preview));
+  QVERIFY(isJpeg(data, preview, 160, 120));
+  QCOMPARE(preview.orientation, 8);
+  QVERIFY(!find(data, 256, &preview));
+  // the photo is 4:3, the thumbnail letterboxed to 3:2
+  QVERIFY(!find(makePhoto(4000, 3000, 160, 107), 128, &preview));
+  QVERIFY(find(makePhoto(3000, 2000, 160, 107), 128, &preview));
+}
+
+void ExifPreviewTest::orientation_data() {
+  QTest::addColumn<bool>("bigEndian");
+  QTest::addColumn<int>("type");
+  QTest::addColumn<int>("value");
+  QTest::addColumn<int>("orientation");
+  QTest::newRow("little endian short") << false << int(TypeShort) << 6 << 6;
+  QTest::newRow("big endian short") << true << int(TypeShort) << 6 << 6;
+  QTest::newRow("little endian long") << false << int(TypeLong) << 3 << 3;
+  QTest::newRow("big endian long") << true << int(TypeLong) << 3 << 3;
+  QTest::newRow("out of range") << false << int(TypeShort) << 9 << 1;
+  QTest::newRow("zero") << true << int(TypeShort) << 0 << 1;
+}
+
+// The orientation of the photo is in IFD0, previews are stored the same way.
+void ExifPreviewTest::orientation() {
+  QFETCH(bool, bigEndian);
+  QFETCH(int, type);
+  QFETCH(int, value);
+  QFETCH(int, orientation);
+  TiffFile tiff(bigEndian);
+  QByteArray thumbnail = jpeg(160, 120);
+  QByteArray large = jpeg(1600, 1200);
+  // the orientation of the other IFDs is not the one of the photo
+  QVector<IfdEntry> entries = stripEntries(tiff.addData(large), large.size());
+  entries << entry(TagOrientation, TypeShort, 2);
+  quint32 ifd1 = tiff.addIfd(entries);
+  entries = jpegEntries(tiff.addData(thumbnail), thumbnail.size());
+  entries.prepend(entry(TagOrientation, type, value));
+  tiff.setFirstIfd(tiff.addIfd(entries, ifd1));
+  Fm::EmbeddedPreview preview;
+  QVERIFY(find(tiff.data(), 128, &preview));
+  QCOMPARE(preview.orientation, orientation);
+  QVERIFY(find(tiff.data(), 256, &preview));
+  QCOMPARE(preview.orientation, orientation);
+}
+
+QTEST_GUILESS_MAIN(ExifPreviewTest)
+#include "exifpreview-test.moc"
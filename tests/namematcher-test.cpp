@@ -0,0 +1,198 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+// The SIMD kernels of the name filter against plain reference versions.
+// This is built once with the default flags (SSE2 on x86-64) and once more
+// with AVX2 if the compiler supports it, see CMakeLists.txt.
+
+#include "namematcher.h"
+#include <QBitArray>
+#include <QByteArray>
+#include <QTest>
+#include <string.h>
+
+class NameMatcherTest: public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void initTestCase();
+  void blockBoundaries();
+  void randomStrings();
+  void longNeedles();
+  void subsequences();
+  void foldedNames();
+  void matchAll();
+};
+
+// the obvious quadratic search the kernels have to agree with
+static int referenceFind(const char* s, int len, const char* needle, int needleLen) {
+  for(int i = 0; i + needleLen <= len; ++i) {
+    if(memcmp(s + i, needle, needleLen) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static bool referenceSubsequence(const char* s, int len, const char* pattern, int patternLen) {
+  int i = 0;
+  for(int pos = 0; pos < len && i < patternLen; ++pos) {
+    if(s[pos] == pattern[i])
+      ++i;
+  }
+  return i == patternLen;
+}
+
+// deterministic, so a failure can be reproduced
+static unsigned int nextRandom(unsigned int* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 8;
+}
+
+void NameMatcherTest::initTestCase() {
+#if defined(__AVX2__) && defined(__GNUC__)
+  if(!__builtin_cpu_supports("avx2"))
+    QSKIP("built for AVX2, which this CPU does not have");
+#endif
+}
+
+// a needle at every position around the 16 and 32 byte blocks of the kernels
+void NameMatcherTest::blockBoundaries() {
+  for(int needleLen = 1; needleLen <= 40; ++needleLen) {
+    QByteArray needle;
+    for(int i = 0; i < needleLen; ++i)
+      needle.append(char('a' + i % 26));
+    for(int len = needleLen; len <= 100; ++len) {
+      for(int pos = 0; pos + needleLen <= len; ++pos) {
+        QByteArray haystack(len, 'x');
+        memcpy(haystack.data() + pos, needle.constData(), needleLen);
+        // a false candidate with the right first and last bytes in front of it
+        if(needleLen > 2 && pos >= needleLen) {
+          haystack[pos - needleLen] = needle[0];
+          haystack[pos - 1] = needle[needleLen - 1];
+        }
+        int found = Fm::findSubstring(haystack.constData(), len, needle.constData(), needleLen);
+        if(found != pos)
+          QFAIL(qPrintable(QString("needle of %1 at %2 in %3 bytes found at %4").arg(needleLen).arg(pos).arg(len).arg(found)));
+      }
+    }
+  }
+}
+
+// a small alphabet gives many partial matches
+void NameMatcherTest::randomStrings() {
+  unsigned int seed = 1;
+  for(int round = 0; round < 20000; ++round) {
+    int len = nextRandom(&seed) % 90;
+    int needleLen = 1 + nextRandom(&seed) % 6;
+    QByteArray haystack(len, 0), needle(needleLen, 0);
+    for(int i = 0; i < len; ++i)
+      haystack[i] = "abc"[nextRandom(&seed) % 3];
+    for(int i = 0; i < needleLen; ++i)
+      needle[i] = "abc"[nextRandom(&seed) % 3];
+    QCOMPARE(Fm::findSubstring(haystack.constData(), len, needle.constData(), needleLen),
+             referenceFind(haystack.constData(), len, needle.constData(), needleLen));
+  }
+}
+
+void NameMatcherTest::longNeedles() {
+  QByteArray name("report.txt");
+  QCOMPARE(Fm::findSubstring(name.constData(), name.size(), "report.txt.bak", 14), -1);
+  QCOMPARE(Fm::findSubstring(name.constData(), name.size(), "report.txt", 10), 0);
+  QCOMPARE(Fm::findSubstring(name.constData(), name.size(), "", 0), 0);
+  QCOMPARE(Fm::findSubstring("", 0, "a", 1), -1);
+  QVERIFY(!Fm::matchesSubsequence(name.constData(), name.size(), "report.txt.bak", 14));
+}
+
+void NameMatcherTest::subsequences() {
+  unsigned int seed = 2;
+  for(int round = 0; round < 20000; ++round) {
+    int len = nextRandom(&seed) % 70;
+    int patternLen = nextRandom(&seed) % 8;
+    QByteArray name(len, 0), pattern(patternLen, 0);
+    for(int i = 0; i < len; ++i)
+      name[i] = "abcd"[nextRandom(&seed) % 4];
+    for(int i = 0; i < patternLen; ++i)
+      pattern[i] = "abcd"[nextRandom(&seed) % 4];
+    QCOMPARE(Fm::matchesSubsequence(name.constData(), len, pattern.constData(), patternLen),
+             referenceSubsequence(name.constData(), len, pattern.constData(), patternLen));
+  }
+}
+
+void NameMatcherTest::foldedNames() {
+  QCOMPARE(Fm::foldName("Photo_2016.JPG", 14), QByteArray("photo_2016.jpg"));
+  QByteArray name("\xc3\x84rger \xc3\x9c" "ber.TXT"); // "Ärger Über.TXT"
+  QByteArray folded = Fm::foldName(name.constData(), name.size());
+  QCOMPARE(folded, QByteArray("\xc3\xa4rger \xc3\xbc" "ber.txt"));
+  // the multi byte characters are found wherever they fall in a block
+  QByteArray pattern = Fm::foldName("\xc3\x9c" "BER", 5);
+  for(int pad = 0; pad < 40; ++pad) {
+    QByteArray padded = QByteArray(pad, 'x') + folded;
+    QCOMPARE(Fm::findSubstring(padded.constData(), padded.size(), pattern.constData(), pattern.size()), pad + 7);
+  }
+}
+
+// the scan over the whole buffer against testing every name on its own
+void NameMatcherTest::matchAll() {
+  static const char* const words[] = {
+    "IMG", "img", "Report", "\xc3\x84pfel", "final", "2016", "tar.gz", "Notes", "x", "\xc3\xa9t\xc3\xa9"
+  };
+  unsigned int seed = 3;
+  Fm::NameBuffer buffer;
+  QVector<QByteArray> names(3000);
+  for(int slot = 0; slot < names.size(); ++slot) {
+    int count = 1 + nextRandom(&seed) % 4;
+    for(int i = 0; i < count; ++i)
+      names[slot] += words[nextRandom(&seed) % 10] + QByteArray(i + 1 < count ? "_" : "");
+    buffer.insert(slot, names[slot].constData());
+  }
+  // enough removals to compact the buffer
+  for(int slot = 0; slot < names.size(); slot += 2) {
+    buffer.remove(slot);
+    names[slot].clear();
+  }
+
+  static const char* const patterns[] = {
+    "img", "g_r", "report_final", "\xc3\xa4pf", "t\xc3\xa9", "2016_x", "_", "zzz", "x_img", "s_2"
+  };
+  for(int p = 0; p < 10; ++p) {
+    QByteArray pattern(patterns[p]);
+    for(int subsequence = 0; subsequence < 2; ++subsequence) {
+      QBitArray matched, live;
+      buffer.matchAll(pattern, subsequence, &matched, &live);
+      for(int slot = 0; slot < names.size(); ++slot) {
+        QByteArray name = Fm::foldName(names[slot].constData(), names[slot].size());
+        bool expected = !names[slot].isEmpty() &&
+          (subsequence ? referenceSubsequence(name.constData(), name.size(), pattern.constData(), pattern.size())
+                       : referenceFind(name.constData(), name.size(), pattern.constData(), pattern.size()) >= 0);
+        QCOMPARE(live.testBit(slot), !names[slot].isEmpty());
+        QCOMPARE(matched.testBit(slot), expected);
+        QCOMPARE(buffer.matches(slot, pattern, subsequence), expected);
+      }
+    }
+  }
+  // a pattern never matches across the end of one name and the start of the next
+  Fm::NameBuffer pair;
+  pair.insert(0, "ab");
+  pair.insert(1, "cd");
+  QBitArray matched, live;
+  pair.matchAll("bc", false, &matched, &live);
+  QCOMPARE(matched.count(true), 0);
+}
+
+QTEST_GUILESS_MAIN(NameMatcherTest)
+#include "namematcher-test.moc"
@@ -0,0 +1,151 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+// readPngInfo() on PNG files put together chunk by chunk, like the
+// thumbnails of the freedesktop.org cache.
+
+#include "pnginfo.h"
+#include <QTest>
+
+class PngInfoTest: public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void thumbnail();
+  void textAfterImageData();
+  void missingHeader();
+  void truncatedChunk();
+  void emptyText();
+};
+
+static QByteArray uint32(quint32 value) {
+  QByteArray bytes(4, '\0');
+  for(int i = 0; i < 4; ++i)
+    bytes[i] = char(value >> (24 - 8 * i));
+  return bytes;
+}
+
+// readPngInfo() does not check the CRC, it is left zero
+static QByteArray chunk(const char* type, const QByteArray& data, quint32 length) {
+  return uint32(length) + QByteArray(type, 4) + data + QByteArray(4, '\0');
+}
+
+static QByteArray chunk(const char* type, const QByteArray& data = QByteArray()) {
+  return chunk(type, data, quint32(data.size()));
+}
+
+static QByteArray header(quint32 width, quint32 height) {
+  // 8 bit RGBA, deflate, adaptive filtering, no interlace
+  return chunk("IHDR", uint32(width) + uint32(height) + QByteArray("\x08\x06\x00\x00\x00", 5));
+}
+
+static QByteArray text(const char* keyword, const char* value) {
+  return chunk("tEXt", QByteArray(keyword) + '\0' + QByteArray(value));
+}
+
+static QByteArray png(const QByteArray& chunks) {
+  return QByteArray("\211PNG\r\n\032\n") + chunks;
+}
+
+static bool read(const QByteArray& data, Fm::PngInfo* info) {
+  return Fm::readPngInfo(data.constData(), data.size(), info);
+}
+
+void PngInfoTest::thumbnail() {
+  QByteArray data = png(header(256, 192)
+                        + text("Thumb::URI", "file:///home/user/photo.jpg")
+                        + text("Thumb::MTime", "1700000000")
+                        + text("Software", "Filer")
+                        + chunk("IDAT", QByteArray(32, 'x'))
+                        + chunk("IEND"));
+  Fm::PngInfo info;
+  QVERIFY(read(data, &info));
+  QCOMPARE(info.width, 256);
+  QCOMPARE(info.height, 192);
+  QCOMPARE(info.text.size(), 3);
+  QCOMPARE(info.text.value("Thumb::URI"), QByteArray("file:///home/user/photo.jpg"));
+  QCOMPARE(info.text.value("Thumb::MTime"), QByteArray("1700000000"));
+  // nothing behind the first image data chunk is needed
+  Fm::PngInfo head;
+  QVERIFY(read(data.left(data.indexOf("IEND") - 4), &head));
+  QCOMPARE(head.text, info.text);
+}
+
+// The text behind the image data is not read, the cache is then checked on
+// the decoded image.
+void PngInfoTest::textAfterImageData() {
+  QByteArray data = png(header(128, 128)
+                        + text("Thumb::URI", "file:///tmp/a.png")
+                        + chunk("IDAT", QByteArray(16, 'x'))
+                        + text("Thumb::MTime", "1700000000")
+                        + chunk("IEND"));
+  Fm::PngInfo info;
+  QVERIFY(read(data, &info));
+  QVERIFY(info.text.contains("Thumb::URI"));
+  QVERIFY(!info.text.contains("Thumb::MTime"));
+}
+
+void PngInfoTest::missingHeader() {
+  Fm::PngInfo info;
+  // IHDR must be the first chunk
+  QVERIFY(!read(png(text("Thumb::MTime", "1") + chunk("IDAT", QByteArray(16, 'x'))), &info));
+  QVERIFY(!read(png(text("Thumb::MTime", "1") + header(64, 64) + chunk("IDAT", QByteArray(16, 'x'))), &info));
+  // too short, or without a size
+  QVERIFY(!read(png(chunk("IHDR", QByteArray(4, '\1')) + chunk("IDAT", QByteArray(16, 'x'))), &info));
+  QVERIFY(!read(png(header(0, 64) + chunk("IDAT", QByteArray(16, 'x'))), &info));
+  QVERIFY(!read(png(header(0x80000000, 64) + chunk("IDAT", QByteArray(16, 'x'))), &info));
+  // not a PNG file at all
+  QByteArray data = png(header(64, 64) + chunk("IDAT", QByteArray(16, 'x')));
+  data[1] = 'J';
+  QVERIFY(!read(data, &info));
+  QVERIFY(!read(QByteArray(), &info));
+}
+
+// A chunk claiming more data than the file has, as in a file cut short
+// while it is written, must not be read past the end.
+void PngInfoTest::truncatedChunk() {
+  Fm::PngInfo info;
+  QByteArray start = png(header(64, 64));
+  QVERIFY(!read(start + chunk("tEXt", QByteArray("Thumb::MTime\0" "1", 14), 15), &info));
+  QVERIFY(!read(start + chunk("tEXt", QByteArray("a\0b", 3), 0xffffffff), &info));
+  QVERIFY(!read(start + chunk("IDAT", QByteArray(4, 'x'), 0x80000000), &info));
+  // cut anywhere up to the end of the first image data chunk
+  QByteArray data = start + text("Thumb::MTime", "1700000000") + chunk("IDAT", QByteArray(16, 'x'));
+  for(int size = 0; size < data.size(); ++size)
+    QVERIFY(!read(data.left(size), &info));
+  QVERIFY(read(data, &info));
+  // the image data must come before the end
+  QVERIFY(!read(start + chunk("IEND"), &info));
+}
+
+// text chunks without a keyword separator, even empty ones, are skipped
+void PngInfoTest::emptyText() {
+  QByteArray data = png(header(64, 64)
+                        + chunk("tEXt")
+                        + chunk("tEXt", "Thumb::MTime")
+                        + text("Thumb::URI", "")
+                        + chunk("IDAT", QByteArray(16, 'x')));
+  Fm::PngInfo info;
+  QVERIFY(read(data, &info));
+  QCOMPARE(info.text.size(), 1);
+  QVERIFY(info.text.contains("Thumb::URI"));
+  QVERIFY(info.text.value("Thumb::URI").isEmpty());
+}
+
+QTEST_GUILESS_MAIN(PngInfoTest)
+#include "pnginfo-test.moc"
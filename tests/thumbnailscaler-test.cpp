@@ -0,0 +1,175 @@
+/*
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+// Quality of Fm::scaleImage() compared with an exact area average and with
+// QImage::scaled(), which thumbnails were scaled with before.
+
+#include "thumbnailscaler.h"
+#include <QImage>
+#include <QTest>
+#include <math.h>
+
+class ThumbnailScalerTest: public QObject {
+  Q_OBJECT
+
+private Q_SLOTS:
+  void quality_data();
+  void quality();
+  void oddEdges();
+  void orientation_data();
+  void orientation();
+};
+
+static int channel(QRgb pixel, int i) {
+  return (pixel >> (8 * i)) & 0xff;
+}
+
+// smooth gradients with a wave, like most photos at thumbnail size
+static QImage makePhoto(int width, int height) {
+  QImage image(width, height, QImage::Format_RGB32);
+  for(int y = 0; y < height; ++y) {
+    QRgb* row = reinterpret_cast<QRgb*>(image.scanLine(y));
+    for(int x = 0; x < width; ++x) {
+      int blue = int(127.5 + 127.5 * sin(x * 0.05) * cos(y * 0.04));
+      row[x] = qRgb(255 * x / (width - 1), 255 * y / (height - 1), blue);
+    }
+  }
+  return image;
+}
+
+// each target pixel is the average of the source area it covers, weighted
+// by how much of each source pixel lies inside
+static QImage areaAverage(const QImage& image, int width, int height) {
+  QImage result(width, height, QImage::Format_RGB32);
+  double scaleX = double(image.width()) / width;
+  double scaleY = double(image.height()) / height;
+  for(int y = 0; y < height; ++y) {
+    double top = y * scaleY, bottom = (y + 1) * scaleY;
+    for(int x = 0; x < width; ++x) {
+      double left = x * scaleX, right = (x + 1) * scaleX;
+      double sum[3] = {0, 0, 0}, total = 0;
+      for(int v = int(top); v < bottom && v < image.height(); ++v) {
+        double weightY = qMin(bottom, v + 1.0) - qMax(top, double(v));
+        const QRgb* row = reinterpret_cast<const QRgb*>(image.constScanLine(v));
+        for(int u = int(left); u < right && u < image.width(); ++u) {
+          double weight = weightY * (qMin(right, u + 1.0) - qMax(left, double(u)));
+          for(int i = 0; i < 3; ++i)
+            sum[i] += weight * channel(row[u], i);
+          total += weight;
+        }
+      }
+      result.setPixel(x, y, qRgb(int(sum[2] / total + 0.5), int(sum[1] / total + 0.5), int(sum[0] / total + 0.5)));
+    }
+  }
+  return result;
+}
+
+// peak signal to noise ratio of the color channels in dB, higher is closer
+static double psnr(const QImage& a, const QImage& b) {
+  double sum = 0;
+  for(int y = 0; y < a.height(); ++y) {
+    const QRgb* rowA = reinterpret_cast<const QRgb*>(a.constScanLine(y));
+    const QRgb* rowB = reinterpret_cast<const QRgb*>(b.constScanLine(y));
+    for(int x = 0; x < a.width(); ++x) {
+      for(int i = 0; i < 3; ++i) {
+        int diff = channel(rowA[x], i) - channel(rowB[x], i);
+        sum += diff * diff;
+      }
+    }
+  }
+  double mse = qMax(sum / (a.width() * a.height() * 3), 1e-6);
+  return 10 * log10(255.0 * 255.0 / mse);
+}
+
+void ThumbnailScalerTest::quality_data() {
+  QTest::addColumn<QSize>("source");
+  QTest::addColumn<QSize>("target");
+  QTest::newRow("camera photo") << QSize(4000, 3000) << QSize(256, 192);
+  QTest::newRow("exact halvings") << QSize(1024, 768) << QSize(256, 192);
+  QTest::newRow("odd size") << QSize(1001, 751) << QSize(128, 96);
+  QTest::newRow("odd after halving") << QSize(333, 211) << QSize(128, 81);
+  QTest::newRow("small odd size") << QSize(257, 129) << QSize(64, 32);
+  QTest::newRow("bilinear only") << QSize(300, 200) << QSize(250, 166);
+}
+
+void ThumbnailScalerTest::quality() {
+  QFETCH(QSize, source);
+  QFETCH(QSize, target);
+  QImage image = makePhoto(source.width(), source.height());
+  QImage scaled = Fm::scaleImage(image, target.width(), target.height());
+  QCOMPARE(scaled.size(), target);
+  double exact = psnr(scaled, areaAverage(image, target.width(), target.height()));
+  double qt = psnr(scaled, image.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+  qDebug("%.1f dB from the area average, %.1f dB from QImage::scaled()", exact, qt);
+  // both are 39 dB or more for every size, the odd size being the worst
+  QVERIFY(exact >= 36);
+  QVERIFY(qt >= 36);
+}
+
+// The last column and row of an odd sized image must still show up in the
+// result, neither dropped nor blown up to a whole pixel at every halving.
+void ThumbnailScalerTest::oddEdges() {
+  QImage image(101, 101, QImage::Format_RGB32);
+  image.fill(qRgb(0, 0, 0));
+  for(int i = 0; i < 101; ++i) {
+    image.setPixel(100, i, qRgb(255, 255, 255));
+    image.setPixel(i, 100, qRgb(255, 255, 255));
+  }
+  QImage scaled = Fm::scaleImage(image, 25, 25);
+  QImage exact = areaAverage(image, 25, 25);
+  QCOMPARE(qGray(scaled.pixel(12, 12)), 0);
+  QVERIFY(qAbs(qGray(scaled.pixel(24, 12)) - qGray(exact.pixel(24, 12))) <= 32);
+  QVERIFY(qAbs(qGray(scaled.pixel(12, 24)) - qGray(exact.pixel(12, 24))) <= 32);
+}
+
+void ThumbnailScalerTest::orientation_data() {
+  // where the top left corner of the stored image ends up in the upright one
+  QTest::addColumn<int>("orientation");
+  QTest::addColumn<bool>("right");
+  QTest::addColumn<bool>("bottom");
+  QTest::newRow("1 upright") << 1 << false << false;
+  QTest::newRow("2 mirrored") << 2 << true << false;
+  QTest::newRow("3 rotated 180") << 3 << true << true;
+  QTest::newRow("4 flipped") << 4 << false << true;
+  QTest::newRow("5 transposed") << 5 << false << false;
+  QTest::newRow("6 rotated 90 cw") << 6 << true << false;
+  QTest::newRow("7 transversed") << 7 << true << true;
+  QTest::newRow("8 rotated 90 ccw") << 8 << false << true;
+}
+
+void ThumbnailScalerTest::orientation() {
+  QFETCH(int, orientation);
+  QFETCH(bool, right);
+  QFETCH(bool, bottom);
+  QImage image(40, 20, QImage::Format_RGB32);
+  image.fill(qRgb(0, 0, 0));
+  for(int y = 0; y < 4; ++y) {
+    for(int x = 0; x < 4; ++x)
+      image.setPixel(x, y, qRgb(255, 0, 0));
+  }
+  bool transposed = orientation >= 5;
+  QImage scaled = Fm::scaleImage(image, transposed ? 10 : 20, transposed ? 20 : 10, orientation);
+  QCOMPARE(scaled.size(), transposed ? QSize(10, 20) : QSize(20, 10));
+  int cornerX = right ? scaled.width() - 1 : 0;
+  int cornerY = bottom ? scaled.height() - 1 : 0;
+  QCOMPARE(qRed(scaled.pixel(cornerX, cornerY)), 255);
+  QCOMPARE(qRed(scaled.pixel(scaled.width() - 1 - cornerX, scaled.height() - 1 - cornerY)), 0);
+}
+
+QTEST_GUILESS_MAIN(ThumbnailScalerTest)
+#include "thumbnailscaler-test.moc"